@@ -0,0 +1,630 @@
+#include "auxbus.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+const size_t AUXBatch::CAPACITY;
+const int AUXBus::DEFAULT_TIMEOUT_MS;
+const int AUXBus::MAX_IN_FLIGHT;
+const int AUXBus::WIRE_WINDOW;
+const AUXBus::Ticket AUXBus::NO_TICKET;
+const size_t AUXBus::MAX_UNSOLICITED;
+
+AUXBus::AUXBus()
+{
+}
+
+AUXBus::~AUXBus()
+{
+    stop();
+}
+
+bool AUXBus::start(int fd)
+{
+    if (m_thread.joinable())
+        stop();
+
+    if (pipe(m_wakePipe) != 0)
+        return false;
+
+    if (!openNotify())
+    {
+        close(m_wakePipe[0]);
+        close(m_wakePipe[1]);
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+        fcntl(m_wakePipe[i], F_SETFL, O_NONBLOCK);
+
+    // Whatever is sitting in the input queue from before we owned the port is stale.
+    tcflush(fd, TCIFLUSH);
+
+    m_fd = fd;
+    m_decoder.reset();
+    m_stats.reset();
+    m_unsolicited.reset();
+    m_notified = false;
+    m_onWire   = 0;
+
+    // Anything a previous connection left behind will never be waited on now.
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        m_slots[i].state    = Slot::FREE;
+        m_slots[i].callback = nullptr;
+    }
+
+    m_running = true;
+    m_thread  = std::thread(&AUXBus::run, this);
+
+    return true;
+}
+
+void AUXBus::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+
+    char c = 0;
+    if (::write(m_wakePipe[1], &c, 1) < 0)
+    {
+        // The thread still notices m_running on its next poll timeout.
+    }
+
+    m_thread.join();
+
+    for (int i = 0; i < 2; i++)
+        close(m_wakePipe[i]);
+    m_wakePipe[0] = m_wakePipe[1] = -1;
+    closeNotify();
+
+    // Nobody is going to answer these any more.
+    expire(Clock::now(), true);
+
+    // The I/O thread is gone, so nothing is pushing any more.
+    m_unsolicited.reset();
+
+    m_fd = -1;
+}
+
+// A ticket is the slot index in the low byte and the slot's generation above it, so a stale ticket
+// can never pick up somebody else's reply.
+static const uint32_t GENERATION_MASK = 0x7fffff;
+
+AUXBus::Ticket AUXBus::send(const AUXCommand &cmd, AUXLane lane, int timeoutMs)
+{
+    return queue(cmd, lane, timeoutMs, ReplyCallback(), false);
+}
+
+bool AUXBus::send(const AUXCommand &cmd, ReplyCallback callback, AUXLane lane, int timeoutMs)
+{
+    if (queue(cmd, lane, timeoutMs, callback, false) != NO_TICKET)
+        return true;
+
+    AUXCommand failed;
+    callback(failed);
+    return false;
+}
+
+void AUXBus::send(const AUXBatch &cmds, Ticket tickets[], AUXLane lane, int timeoutMs)
+{
+    for (size_t i = 0; i < cmds.size(); i++)
+        tickets[i] = NO_TICKET;
+
+    if (!m_running)
+        return;
+
+    Clock::time_point now = Clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (lane == LANE_URGENT)
+            skipPolls(lock);
+
+        for (size_t i = 0; i < cmds.size(); i++)
+            tickets[i] = claim(cmds[i], lane, timeoutMs, ReplyCallback(), false, now);
+    }
+
+    pump();
+    wake();
+}
+
+AUXBus::Ticket AUXBus::post(const AUXCommand &cmd, AUXLane lane, int timeoutMs)
+{
+    return queue(cmd, lane, timeoutMs, ReplyCallback(), true);
+}
+
+AUXBus::Ticket AUXBus::queue(const AUXCommand &cmd, AUXLane lane, int timeoutMs,
+                             const ReplyCallback &callback, bool posted)
+{
+    if (!m_running)
+        return NO_TICKET;
+
+    Clock::time_point now = Clock::now();
+    Ticket ticket;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // Polls that haven't gone out yet would only hold an urgent command up, and the next
+        // poll cycle asks again anyway.
+        if (lane == LANE_URGENT)
+            skipPolls(lock);
+
+        ticket = claim(cmd, lane, timeoutMs, callback, posted, now);
+    }
+
+    if (ticket == NO_TICKET)
+        return NO_TICKET;
+
+    pump();
+    wake();
+
+    return ticket;
+}
+
+AUXBus::Ticket AUXBus::claim(const AUXCommand &cmd, AUXLane lane, int timeoutMs,
+                             const ReplyCallback &callback, bool posted, Clock::time_point now)
+{
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        Slot &slot = m_slots[i];
+        if (slot.state != Slot::FREE)
+            continue;
+
+        slot.state      = Slot::QUEUED;
+        slot.generation = (slot.generation + 1) & GENERATION_MASK;
+        slot.sequence   = m_nextSequence++;
+        slot.src        = cmd.src;
+        slot.dst        = cmd.dst;
+        slot.cmd        = cmd.cmd;
+        slot.lane       = lane;
+        slot.posted     = posted;
+        slot.queued     = now;
+        slot.deadline   = now + std::chrono::milliseconds(timeoutMs);
+        slot.callback   = callback;
+        cmd.fillBuf(slot.frame);
+
+        return static_cast<Ticket>(slot.generation << 8 | i);
+    }
+
+    return NO_TICKET;
+}
+
+void AUXBus::wake()
+{
+    // Wake the reader so it picks up the new deadline.
+    char c = 0;
+    if (::write(m_wakePipe[1], &c, 1) < 0)
+    {
+        // Pipe is full, so the reader is already awake.
+    }
+}
+
+void AUXBus::skipPolls(std::unique_lock<std::mutex> &lock)
+{
+    AUXCommand skipped;
+
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        if (m_slots[i].state != Slot::QUEUED || m_slots[i].lane != LANE_POLL)
+            continue;
+
+        m_stats.skipped(LANE_POLL);
+        complete(lock, i, skipped);
+    }
+}
+
+void AUXBus::pump()
+{
+    // Held throughout, so bursts go out in the order they were picked and never interleave.
+    std::lock_guard<std::mutex> writeLock(m_writeMutex);
+
+    for (;;)
+    {
+        Clock::time_point now = Clock::now();
+        size_t bytes          = 0;
+        uint32_t frames       = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (;;)
+            {
+                int next = -1;
+                for (int i = 0; i < MAX_IN_FLIGHT; i++)
+                {
+                    const Slot &slot = m_slots[i];
+                    if (slot.state == Slot::QUEUED &&
+                        (next < 0 || slot.lane < m_slots[next].lane ||
+                         (slot.lane == m_slots[next].lane &&
+                          slot.sequence < m_slots[next].sequence)))
+                    {
+                        next = i;
+                    }
+                }
+
+                // Urgent commands don't wait for room; the window is there to keep them from
+                // queueing behind everything else.
+                if (next < 0 || (m_onWire >= WIRE_WINDOW && m_slots[next].lane != LANE_URGENT))
+                    break;
+
+                // Registered as waiting before the write, so a fast reply can't arrive before we
+                // know to expect it. The frame is copied out because once the lock is dropped the
+                // slot can time out and be reused.
+                Slot &slot = m_slots[next];
+                slot.state = Slot::WAITING;
+                slot.sent  = now;
+                m_onWire++;
+
+                m_stats.queued(slot.lane, now - slot.queued);
+
+                // Before the write, so a quick reply can't land in the trace ahead of its request.
+                if (m_trace != nullptr)
+                    m_trace->record(AUXTrace::TO_MOUNT, now, slot.frame.data(), slot.frame.size());
+
+                memcpy(m_burst + bytes, slot.frame.data(), slot.frame.size());
+                bytes += slot.frame.size();
+                frames++;
+            }
+        }
+
+        if (frames == 0)
+            return;
+
+        // Everything picked goes out in one write. If it fails the slots stay registered and come
+        // back as timeouts.
+        if (write(m_burst, bytes))
+            m_stats.wrote(bytes, frames);
+    }
+}
+
+bool AUXBus::write(const unsigned char *data, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t n = ::write(m_fd, data + written, size - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+            return false;
+
+        written += n;
+    }
+
+    return true;
+}
+
+bool AUXBus::wait(Ticket ticket, AUXCommand &reply)
+{
+    reply.valid = false;
+
+    if (ticket == NO_TICKET)
+        return false;
+
+    int index           = ticket & 0xff;
+    uint32_t generation = static_cast<uint32_t>(ticket) >> 8;
+    Slot &slot          = m_slots[index];
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (slot.generation != generation)
+        return false;
+
+    // The reader times requests out on its own; this only guards against it having died.
+    Clock::time_point backstop = slot.deadline + std::chrono::milliseconds(DEFAULT_TIMEOUT_MS);
+    bool backstopped           = false;
+    while (slot.state != Slot::DONE)
+    {
+        if (m_replied.wait_until(lock, backstop) != std::cv_status::timeout)
+            continue;
+
+        // Ended the way the reader would have, so a slot on the wire gives its place back.
+        if (slot.state == Slot::QUEUED || slot.state == Slot::WAITING)
+        {
+            AUXCommand timedOut;
+            m_stats.timedOut(slot.cmd);
+            complete(lock, index, timedOut);
+            backstopped = true;
+        }
+        // Anything else isn't a slot this ticket owns any more; leave it to whoever does.
+        else if (slot.state != Slot::DONE)
+            return false;
+    }
+
+    reply      = slot.reply;
+    slot.state = Slot::FREE;
+
+    // With the reader gone nobody else makes use of the room on the wire.
+    if (backstopped)
+    {
+        lock.unlock();
+        pump();
+    }
+
+    return reply.valid;
+}
+
+AUXBus::Result AUXBus::collect(Ticket ticket, AUXCommand &reply)
+{
+    reply.valid = false;
+
+    if (ticket == NO_TICKET)
+        return FAILED;
+
+    int index           = ticket & 0xff;
+    uint32_t generation = static_cast<uint32_t>(ticket) >> 8;
+    Slot &slot          = m_slots[index];
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Already collected, or left over from before the bus was restarted.
+    if (slot.generation != generation || slot.state == Slot::FREE)
+        return FAILED;
+
+    if (slot.state != Slot::DONE)
+        return PENDING;
+
+    reply      = slot.reply;
+    slot.state = Slot::FREE;
+
+    return reply.valid ? REPLIED : FAILED;
+}
+
+bool AUXBus::nextUnsolicited(AUXCommand &cmd)
+{
+    return m_unsolicited.pop(cmd);
+}
+
+bool AUXBus::openNotify()
+{
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    m_notifyFD[0] = m_notifyFD[1] = fd;
+    return true;
+#else
+    if (pipe(m_notifyFD) != 0)
+        return false;
+
+    for (int i = 0; i < 2; i++)
+        fcntl(m_notifyFD[i], F_SETFL, O_NONBLOCK);
+    return true;
+#endif
+}
+
+void AUXBus::closeNotify()
+{
+    close(m_notifyFD[0]);
+    if (m_notifyFD[1] != m_notifyFD[0])
+        close(m_notifyFD[1]);
+
+    m_notifyFD[0] = m_notifyFD[1] = -1;
+}
+
+void AUXBus::notify()
+{
+    // Already signalled and not yet drained; the consumer will get to this frame too.
+    if (m_notified.exchange(true, std::memory_order_acq_rel))
+        return;
+
+#ifdef __linux__
+    uint64_t one = 1;
+    if (::write(m_notifyFD[1], &one, sizeof(one)) < 0)
+#else
+    char c = 0;
+    if (::write(m_notifyFD[1], &c, 1) < 0)
+#endif
+    {
+        // Full, so the consumer has a wakeup pending already.
+    }
+}
+
+void AUXBus::clearNotify()
+{
+    // Drain the fd before clearing the flag: a frame pushed in between then either finds the flag
+    // still set and is picked up by the drain that follows, or signals again.
+#ifdef __linux__
+    uint64_t count;
+    if (read(m_notifyFD[0], &count, sizeof(count)) < 0)
+    {
+        // Nothing was pending.
+    }
+#else
+    char drain[16];
+    while (read(m_notifyFD[0], drain, sizeof(drain)) > 0)
+        ;
+#endif
+
+    m_notified.exchange(false, std::memory_order_acq_rel);
+}
+
+void AUXBus::complete(std::unique_lock<std::mutex> &lock, int index, const AUXCommand &reply)
+{
+    Slot &slot = m_slots[index];
+
+    if (slot.state == Slot::WAITING)
+        m_onWire--;
+
+    if (slot.callback)
+    {
+        // Outside the lock, so a callback is free to send the next command.
+        slot.state = Slot::CALLING;
+        lock.unlock();
+        slot.callback(reply);
+        lock.lock();
+
+        slot.callback = nullptr;
+        slot.state    = Slot::FREE;
+    }
+    else
+    {
+        slot.reply = reply;
+        slot.state = Slot::DONE;
+
+        if (slot.posted)
+            notify();
+        else
+            m_replied.notify_all();
+    }
+}
+
+void AUXBus::dispatch(const AUXCommand &frame, Clock::time_point now)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Replies come back with src and dst swapped. Oldest request wins if the same query is
+    // outstanding twice.
+    int match = -1;
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        const Slot &slot = m_slots[i];
+        if (slot.state == Slot::WAITING && slot.cmd == frame.cmd && slot.dst == frame.src &&
+            (slot.src == frame.dst || slot.src == ANY) &&
+            (match < 0 || slot.sequence < m_slots[match].sequence))
+        {
+            match = i;
+        }
+    }
+
+    if (match >= 0)
+    {
+        m_stats.replied(frame.cmd, now - m_slots[match].sent);
+        complete(lock, match, frame);
+        return;
+    }
+
+    lock.unlock();
+
+    // A full queue drops the newest frame, counted in unsolicitedOverflows(); the consumer still
+    // has a wakeup pending for the ones already queued.
+    if (m_unsolicited.push(frame))
+        notify();
+}
+
+void AUXBus::expire(Clock::time_point now, bool all)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    AUXCommand timedOut;
+
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        Slot::State state = m_slots[i].state;
+        if ((state != Slot::QUEUED && state != Slot::WAITING) ||
+            (!all && m_slots[i].deadline > now))
+            continue;
+
+        // Requests dropped by stop() never had the chance to time out.
+        if (!all)
+            m_stats.timedOut(m_slots[i].cmd);
+
+        complete(lock, i, timedOut);
+    }
+}
+
+int AUXBus::msUntilNextDeadline(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Wake up now and then even when idle, so stop() never depends on the pipe alone.
+    int timeout = 1000;
+
+    for (int i = 0; i < MAX_IN_FLIGHT; i++)
+    {
+        if (m_slots[i].state != Slot::QUEUED && m_slots[i].state != Slot::WAITING)
+            continue;
+
+        Clock::duration left = m_slots[i].deadline - now;
+        int ms = std::chrono::duration_cast<std::chrono::milliseconds>(left).count();
+        if (ms < 0)
+            ms = 0;
+        if (ms < timeout)
+            timeout = ms + 1;
+    }
+
+    return timeout;
+}
+
+void AUXBus::run()
+{
+    unsigned char chunk[64];
+    AUXCommand frame;
+
+    while (m_running)
+    {
+        struct pollfd fds[2];
+        fds[0].fd     = m_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = m_wakePipe[0];
+        fds[1].events = POLLIN;
+
+        int ready = poll(fds, 2, msUntilNextDeadline(Clock::now()));
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready > 0 && (fds[1].revents & POLLIN))
+        {
+            char drain[16];
+            while (read(m_wakePipe[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN))
+        {
+            size_t space = std::min(sizeof(chunk), m_decoder.freeSpace());
+            ssize_t n    = read(m_fd, chunk, space);
+            if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))
+                break;
+
+            if (n > 0)
+            {
+                Clock::time_point now = Clock::now();
+
+                m_stats.read(n);
+                if (m_trace != nullptr)
+                    m_trace->record(AUXTrace::FROM_MOUNT, now, chunk, n);
+
+                m_decoder.feed(chunk, n);
+
+                while (m_decoder.next(frame))
+                {
+                    m_stats.decoded();
+                    dispatch(frame, now);
+                }
+
+                m_stats.decoderErrors(m_decoder.checksumErrors(), m_decoder.resyncs());
+            }
+        }
+        else if (ready > 0 && (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            // The port went away underneath us (cable pulled, pty closed).
+            break;
+        }
+
+        expire(Clock::now(), false);
+
+        // Replies and timeouts make room on the wire.
+        pump();
+    }
+
+    // Whether we were stopped or lost the port, no more replies are coming.
+    m_running = false;
+    expire(Clock::now(), true);
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "auxdecoder.h"
+#include "auxproto.h"
+#include "auxstats.h"
+#include "auxtrace.h"
+#include "spscqueue.h"
+
+/*
+A handful of commands that go out together. Fixed capacity, so building a poll cycle's worth of
+queries doesn't allocate.
+*/
+class AUXBatch
+{
+  public:
+    static const size_t CAPACITY = 16;
+
+    AUXBatch()
+    {
+    }
+    AUXBatch(std::initializer_list<AUXCommand> cmds)
+    {
+        for (const AUXCommand &cmd : cmds)
+            push_back(cmd);
+    }
+
+    bool push_back(const AUXCommand &cmd)
+    {
+        if (m_count >= CAPACITY)
+            return false;
+
+        m_cmds[m_count++] = cmd;
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_count;
+    }
+    const AUXCommand &operator[](size_t i) const
+    {
+        return m_cmds[i];
+    }
+
+  private:
+    AUXCommand m_cmds[CAPACITY];
+    size_t m_count{0};
+};
+
+/*
+Owns the serial port once the mount is connected.
+
+A dedicated thread reads and decodes everything the mount sends. Commands can be sent from any
+thread and up to MAX_IN_FLIGHT of them can be outstanding at once; each reply is matched back to
+its request by (src, dst, cmd). send() hands back a ticket to wait() on, or takes a callback.
+post() hands back a ticket to collect() later, and signals notifyFD() when the reply is in, so an
+event loop can carry on meanwhile. Replies that time out are delivered as a command with
+valid == false. Frames nobody asked for are queued and can be picked up with nextUnsolicited().
+
+Every command goes in a lane. The mount works through commands one at a time, so only WIRE_WINDOW
+of them are written ahead of their replies; the rest wait in the bus, and whenever there's room
+the most urgent lane goes first, oldest first within a lane. Guide pulses and aborts don't wait
+for room at all, and sending one drops any polls still waiting, which fail as if they had timed
+out. Commands that are ready together are written together, in one burst.
+
+The unsolicited queue is a lock-free single producer, single consumer ring: the I/O thread pushes
+and one other thread, the INDI event loop in the driver, pops. The I/O thread signals notifyFD()
+when the queue goes from drained to not, so a burst of frames costs one wakeup.
+
+Requests live in a fixed pool of slots and the unsolicited queue is a fixed ring, so once started
+the bus doesn't allocate. Traffic, timeouts, round trip times and each lane's queueing delay are
+counted in stats(), which start() resets, and every byte each way can be recorded to an AUXTrace.
+*/
+class AUXBus
+{
+  public:
+    // Runs on the I/O thread, so it must not touch INDI properties.
+    typedef std::function<void(const AUXCommand &reply)> ReplyCallback;
+    typedef int32_t Ticket;
+
+    static const int DEFAULT_TIMEOUT_MS = 500;
+    static const int MAX_IN_FLIGHT      = 16;
+    static const int WIRE_WINDOW        = 2;
+    static const Ticket NO_TICKET       = -1;
+
+    enum Result
+    {
+        PENDING,
+        REPLIED,
+        FAILED
+    };
+
+    AUXBus();
+    ~AUXBus();
+
+    bool start(int fd);
+    void stop();
+    bool running() const
+    {
+        return m_running;
+    }
+
+    // Returns NO_TICKET if the command could not be sent. The timeout counts from here, so it
+    // includes the time spent queued.
+    Ticket send(const AUXCommand &cmd, AUXLane lane = LANE_MOTION,
+                int timeoutMs = DEFAULT_TIMEOUT_MS);
+    bool send(const AUXCommand &cmd, ReplyCallback callback, AUXLane lane = LANE_MOTION,
+              int timeoutMs = DEFAULT_TIMEOUT_MS);
+    // Queues the whole batch at once, so whatever fits on the wire goes out in a single write.
+    // Fills one ticket per command, NO_TICKET for any that could not be sent.
+    void send(const AUXBatch &cmds, Ticket tickets[], AUXLane lane = LANE_MOTION,
+              int timeoutMs = DEFAULT_TIMEOUT_MS);
+    Ticket post(const AUXCommand &cmd, AUXLane lane, int timeoutMs = DEFAULT_TIMEOUT_MS);
+
+    // Blocks until the reply for a send() ticket is in. Every ticket must be waited on or
+    // collected exactly once.
+    bool wait(Ticket ticket, AUXCommand &reply);
+    // Doesn't block. A ticket is done with once this returns anything but PENDING.
+    Result collect(Ticket ticket, AUXCommand &reply);
+
+    // Only ever from one thread at a time.
+    bool nextUnsolicited(AUXCommand &cmd);
+
+    // Becomes readable whenever an unsolicited frame is queued or a posted command completes.
+    // Call clearNotify() before draining.
+    int notifyFD() const
+    {
+        return m_notifyFD[0];
+    }
+    void clearNotify();
+
+    // Unsolicited frames waiting now, the most there have been since start(), and how many were
+    // dropped because the queue was full.
+    size_t unsolicitedDepth() const
+    {
+        return m_unsolicited.size();
+    }
+    size_t unsolicitedHighWater() const
+    {
+        return m_unsolicited.highWater();
+    }
+    uint64_t unsolicitedOverflows() const
+    {
+        return m_unsolicited.overflows();
+    }
+
+    const AUXStats &stats() const
+    {
+        return m_stats;
+    }
+
+    // Set before start(); the bus records into it whenever it is started.
+    void setTrace(AUXTrace *trace)
+    {
+        m_trace = trace;
+    }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t MAX_UNSOLICITED = 64;
+
+    struct Slot
+    {
+        enum State
+        {
+            FREE,
+            // Waiting for its turn on the wire.
+            QUEUED,
+            // Written, waiting for the reply.
+            WAITING,
+            // Callback is running outside the lock; the slot can't be reused yet.
+            CALLING,
+            DONE
+        };
+
+        State state{FREE};
+        uint32_t generation{0};
+        uint64_t sequence{0};
+        AUXtargets src{ANY};
+        AUXtargets dst{ANY};
+        AUXCommands cmd{GET_VER};
+        AUXLane lane{LANE_MOTION};
+        bool posted{false};
+        buffer frame;
+        Clock::time_point queued;
+        Clock::time_point sent;
+        Clock::time_point deadline;
+        AUXCommand reply;
+        ReplyCallback callback;
+    };
+
+    Ticket queue(const AUXCommand &cmd, AUXLane lane, int timeoutMs, const ReplyCallback &callback,
+                 bool posted);
+    // Takes a free slot for the command. Called with the lock held.
+    Ticket claim(const AUXCommand &cmd, AUXLane lane, int timeoutMs, const ReplyCallback &callback,
+                 bool posted, Clock::time_point now);
+    void wake();
+    // Drops the polls still waiting for the wire. Called with the lock held.
+    void skipPolls(std::unique_lock<std::mutex> &lock);
+    // Writes queued commands, most urgent first, while there's room on the wire.
+    void pump();
+    bool write(const unsigned char *data, size_t size);
+    void run();
+    void dispatch(const AUXCommand &frame, Clock::time_point now);
+    // Completes a slot. Called with the lock held; drops it while a callback runs.
+    void complete(std::unique_lock<std::mutex> &lock, int index, const AUXCommand &reply);
+    void expire(Clock::time_point now, bool all);
+    int msUntilNextDeadline(Clock::time_point now);
+
+    bool openNotify();
+    void closeNotify();
+    void notify();
+
+    int m_fd{-1};
+    int m_wakePipe[2]{-1, -1};
+    // Read and write ends; the same eventfd twice where there is one.
+    int m_notifyFD[2]{-1, -1};
+    // Set by the I/O thread when it signals, cleared by clearNotify(), so it signals once per
+    // drain rather than once per frame.
+    std::atomic<bool> m_notified{false};
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+
+    // Guards the slots.
+    std::mutex m_mutex;
+    std::condition_variable m_replied;
+    // Serializes writers so frames from different threads never interleave on the wire.
+    std::mutex m_writeMutex;
+    // The frames being written; guarded by m_writeMutex.
+    unsigned char m_burst[MAX_IN_FLIGHT * buffer::CAPACITY];
+
+    Slot m_slots[MAX_IN_FLIGHT];
+    uint64_t m_nextSequence{0};
+    // Slots written and not yet answered.
+    int m_onWire{0};
+
+    SPSCQueue<AUXCommand, MAX_UNSOLICITED> m_unsolicited;
+
+    // Only touched by the I/O thread.
+    AUXFrameDecoder m_decoder;
+
+    AUXStats m_stats;
+    AUXTrace *m_trace{nullptr};
+};
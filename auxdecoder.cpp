@@ -0,0 +1,121 @@
+#include "auxdecoder.h"
+
+#include <string.h>
+
+// Smallest len byte is src + dst + cmd. Anything longer than this can't be an AUX frame we know
+// about, so treat it as line noise rather than waiting for hundreds of bytes that never come.
+static const uint8_t MIN_FRAME_LEN = 3;
+static const uint8_t MAX_FRAME_LEN = 29;
+
+AUXFrameDecoder::AUXFrameDecoder()
+{
+    memset(m_ring, 0, sizeof(m_ring));
+}
+
+size_t AUXFrameDecoder::freeSpace() const
+{
+    return RING_SIZE - available();
+}
+
+size_t AUXFrameDecoder::feed(const unsigned char *data, size_t n)
+{
+    size_t count = n < freeSpace() ? n : freeSpace();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        m_ring[(m_head + i) & RING_MASK] = data[i];
+    }
+    m_head += count;
+
+    return count;
+}
+
+void AUXFrameDecoder::reset()
+{
+    m_head     = 0;
+    m_tail     = 0;
+    m_state    = SEEK_START;
+    m_frameLen = 0;
+    m_skipping = false;
+
+    m_checksumErrors = 0;
+    m_resyncs        = 0;
+}
+
+void AUXFrameDecoder::resync()
+{
+    m_tail++;
+    m_state    = SEEK_START;
+    m_skipping = true;
+    m_resyncs++;
+}
+
+bool AUXFrameDecoder::next(AUXCommand &cmd)
+{
+    for (;;)
+    {
+        switch (m_state)
+        {
+        case SEEK_START:
+            while (available() > 0 && at(0) != START_BYTE)
+            {
+                if (!m_skipping)
+                {
+                    m_skipping = true;
+                    m_resyncs++;
+                }
+                m_tail++;
+            }
+
+            if (available() == 0)
+                return false;
+
+            m_skipping = false;
+            m_state    = READ_LENGTH;
+            break;
+
+        case READ_LENGTH:
+            if (available() < 2)
+                return false;
+
+            m_frameLen = at(1);
+            if (m_frameLen < MIN_FRAME_LEN || m_frameLen > MAX_FRAME_LEN)
+            {
+                resync();
+                break;
+            }
+
+            m_state = READ_BODY;
+            break;
+
+        case READ_BODY:
+        {
+            // start + len + body + checksum
+            size_t frameSize = m_frameLen + 3;
+            if (available() < frameSize)
+                return false;
+
+            int cs = 0;
+            for (size_t i = 1; i < frameSize - 1; i++)
+                cs += at(i);
+
+            if ((unsigned char)(((~cs) + 1) & 0xFF) != at(frameSize - 1))
+            {
+                m_checksumErrors++;
+                resync();
+                break;
+            }
+
+            buffer frame(frameSize);
+            for (size_t i = 0; i < frameSize; i++)
+                frame[i] = at(i);
+
+            m_tail += frameSize;
+            m_state = SEEK_START;
+
+            cmd.parseBuf(frame);
+            return true;
+        }
+        }
+    }
+}
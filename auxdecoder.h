@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "auxproto.h"
+
+/*
+Incremental decoder for AUX frames.
+
+Bytes are pushed in whatever chunks the port hands us with feed(), and complete frames are pulled
+out with next(). Frames look like this:
+
+    0x3b | len | src | dst | cmd | data... | checksum
+
+where len counts src, dst, cmd and the data bytes. A frame with a bad length or checksum is not
+thrown away as a whole; the decoder skips its start byte and resyncs on the next 0x3b, so a real
+frame hiding inside the garbage is still found.
+*/
+class AUXFrameDecoder
+{
+  public:
+    static const uint8_t START_BYTE = 0x3b;
+
+    AUXFrameDecoder();
+
+    // Copies up to n bytes into the ring. Returns how many were accepted.
+    size_t feed(const unsigned char *data, size_t n);
+
+    // Bytes that can be fed before the ring is full.
+    size_t freeSpace() const;
+
+    // Extracts the next complete frame. Returns false if more bytes are needed.
+    bool next(AUXCommand &cmd);
+
+    // Also clears the error counts.
+    void reset();
+
+    uint32_t checksumErrors() const
+    {
+        return m_checksumErrors;
+    }
+    uint32_t resyncs() const
+    {
+        return m_resyncs;
+    }
+
+  private:
+    // Must be a power of two.
+    static const size_t RING_SIZE = 256;
+    static const size_t RING_MASK = RING_SIZE - 1;
+
+    enum State
+    {
+        SEEK_START,
+        READ_LENGTH,
+        READ_BODY
+    };
+
+    unsigned char at(size_t offset) const
+    {
+        return m_ring[(m_tail + offset) & RING_MASK];
+    }
+    size_t available() const
+    {
+        return m_head - m_tail;
+    }
+
+    // Drops the start byte of the current candidate frame and goes looking for the next one.
+    void resync();
+
+    unsigned char m_ring[RING_SIZE];
+    size_t m_head{0};
+    size_t m_tail{0};
+
+    State m_state{SEEK_START};
+    uint8_t m_frameLen{0};
+    // Set while dropping bytes between frames, so one run of noise counts as one resync.
+    bool m_skipping{false};
+
+    uint32_t m_checksumErrors{0};
+    uint32_t m_resyncs{0};
+};
@@ -0,0 +1,91 @@
+#include "auxdispatcher.h"
+
+int AUXDispatcher::subscribe(AUXCommands cmd, AUXtargets src, Handler handler)
+{
+    Subscription sub;
+    sub.id         = m_nextId++;
+    sub.anyCommand = false;
+    sub.cmd        = cmd;
+    sub.src        = src;
+    sub.handler    = handler;
+
+    if (m_dispatching)
+        m_pending.push_back(sub);
+    else
+        m_subscriptions.push_back(sub);
+
+    return sub.id;
+}
+
+int AUXDispatcher::subscribeSource(AUXtargets src, Handler handler)
+{
+    int id = subscribe(GET_VER, src, handler);
+
+    (m_dispatching ? m_pending : m_subscriptions).back().anyCommand = true;
+
+    return id;
+}
+
+void AUXDispatcher::unsubscribe(int id)
+{
+    for (std::vector<Subscription>::iterator it = m_subscriptions.begin();
+         it != m_subscriptions.end(); ++it)
+    {
+        if (it->id == id)
+        {
+            if (m_dispatching)
+                it->id = 0;
+            else
+                m_subscriptions.erase(it);
+            return;
+        }
+    }
+
+    for (std::vector<Subscription>::iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+    {
+        if (it->id == id)
+        {
+            m_pending.erase(it);
+            return;
+        }
+    }
+}
+
+bool AUXDispatcher::dispatch(const AUXCommand &cmd)
+{
+    bool handled  = false;
+    m_dispatching = true;
+
+    // Handlers run in place rather than from a copy, so dispatching never allocates.
+    for (size_t i = 0; i < m_subscriptions.size(); i++)
+    {
+        if (m_subscriptions[i].id != 0 &&
+            (m_subscriptions[i].anyCommand || m_subscriptions[i].cmd == cmd.cmd) &&
+            (m_subscriptions[i].src == ANY || m_subscriptions[i].src == cmd.src))
+        {
+            m_subscriptions[i].handler(cmd);
+            handled = true;
+        }
+    }
+
+    m_dispatching = false;
+
+    for (size_t i = m_subscriptions.size(); i > 0; i--)
+    {
+        if (m_subscriptions[i - 1].id == 0)
+            m_subscriptions.erase(m_subscriptions.begin() + (i - 1));
+    }
+
+    if (!m_pending.empty())
+    {
+        m_subscriptions.insert(m_subscriptions.end(), m_pending.begin(), m_pending.end());
+        m_pending.clear();
+    }
+
+    if (!handled && m_fallback)
+    {
+        m_fallback(cmd);
+    }
+
+    return handled;
+}
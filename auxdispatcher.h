@@ -0,0 +1,52 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+#include <vector>
+
+#include "auxproto.h"
+
+/*
+Routes frames the mount sends on its own (slew finished, level finished, hand controller chatter)
+to whoever registered for them. Subscriptions match on command and source node; ANY as the source
+matches every node. Frames with no subscriber go to the fallback handler.
+
+Everything here runs on the INDI thread, so handlers are free to update properties.
+*/
+class AUXDispatcher
+{
+  public:
+    typedef std::function<void(const AUXCommand &cmd)> Handler;
+
+    // Returns an id that can be passed to unsubscribe().
+    int subscribe(AUXCommands cmd, AUXtargets src, Handler handler);
+    // Every command from src.
+    int subscribeSource(AUXtargets src, Handler handler);
+    void unsubscribe(int id);
+
+    void setFallback(Handler handler)
+    {
+        m_fallback = handler;
+    }
+
+    // Returns true if at least one subscriber handled the frame.
+    bool dispatch(const AUXCommand &cmd);
+
+  private:
+    struct Subscription
+    {
+        int id;
+        bool anyCommand;
+        AUXCommands cmd;
+        AUXtargets src;
+        Handler handler;
+    };
+
+    std::vector<Subscription> m_subscriptions;
+    // Subscriptions made from inside a handler; they join m_subscriptions once dispatch is done.
+    std::vector<Subscription> m_pending;
+    Handler m_fallback;
+    int m_nextId{1};
+    // While set, unsubscribe() only marks entries so handlers never move under a running call.
+    bool m_dispatching{false};
+};
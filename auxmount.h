@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "auxproto.h"
+
+/*
+Something standing in for the mount at the other end of the port: the simulator, or a recorded
+trace played back.
+
+Bytes the driver writes go in through receive() and frames for the driver come out of
+nextFrame(). Time only moves when advance() is called.
+*/
+class AUXMount
+{
+  public:
+    virtual ~AUXMount()
+    {
+    }
+
+    virtual void receive(const unsigned char *data, size_t n) = 0;
+    virtual void advance(double seconds)                       = 0;
+    virtual bool nextFrame(buffer &frame)                      = 0;
+};
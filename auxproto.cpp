@@ -17,7 +17,7 @@ bool DEBUG      = true;
 /////// Utility functions
 //////////////////////////////////////////////////
 
-void prnBytes(unsigned char *b, int n)
+void prnBytes(const unsigned char *b, int n)
 {
     fprintf(stderr, "[");
     for (int i = 0; i < n; i++)
@@ -25,7 +25,7 @@ void prnBytes(unsigned char *b, int n)
     fprintf(stderr, "]\n");
 }
 
-void dumpMsg(buffer buf)
+void dumpMsg(const buffer &buf)
 {
     fprintf(stderr, "MSG: ");
     for (unsigned int i = 0; i < buf.size(); i++)
@@ -41,35 +41,33 @@ void dumpMsg(buffer buf)
 
 AUXCommand::AUXCommand()
 {
-    data.reserve(MAX_CMD_LEN);
 }
 
-AUXCommand::AUXCommand(buffer buf)
+AUXCommand::AUXCommand(const buffer &buf)
 {
-    data.reserve(MAX_CMD_LEN);
     parseBuf(buf);
 }
 
-AUXCommand::AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d, buffer dat)
+AUXCommand::AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d, const buffer &dat)
 {
-    cmd = c;
-    src = s;
-    dst = d;
-    data.reserve(MAX_CMD_LEN);
-    data = dat;
-    len  = 3 + data.size();
+    cmd   = c;
+    src   = s;
+    dst   = d;
+    data  = dat;
+    len   = 3 + data.size();
+    valid = true;
 }
 
 AUXCommand::AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d)
 {
-    cmd = c;
-    src = s;
-    dst = d;
-    data.reserve(MAX_CMD_LEN);
-    len = 3 + data.size();
+    cmd   = c;
+    src   = s;
+    dst   = d;
+    len   = 3 + data.size();
+    valid = true;
 }
 
-void AUXCommand::dumpCmd()
+void AUXCommand::dumpCmd() const
 {
     if (DEBUG)
     {
@@ -82,120 +80,32 @@ void AUXCommand::dumpCmd()
     }
 }
 
-const char *AUXCommand::cmd_name(AUXCommands c)
+const char *AUXCommand::cmd_name(AUXCommands c) const
 {
+    // GPS speaks its own command set that happens to reuse the ids.
     if (src == GPS || dst == GPS)
         return nullptr;
-    else
-        switch (c)
-        {
-        case MC_GET_POSITION:
-            return "MC_GET_POSITION";
-        case MC_GOTO_FAST:
-            return "MC_GOTO_FAST";
-        case MC_SET_POSITION:
-            return "MC_SET_POSITION";
-        case MC_SET_POS_GUIDERATE:
-            return "MC_SET_POS_GUIDERATE";
-        case MC_SET_NEG_GUIDERATE:
-            return "MC_SET_NEG_GUIDERATE";
-        case MC_LEVEL_START:
-            return "MC_LEVEL_START";
-        case MC_SLEW_DONE:
-            return "MC_SLEW_DONE";
-        case MC_GOTO_SLOW:
-            return "MC_GOTO_SLOW";
-        case MC_SEEK_INDEX:
-            return "MC_SEEK_INDEX";
-        case MC_MOVE_POS:
-            return "MC_MOVE_POS";
-        case MC_MOVE_NEG:
-            return "MC_MOVE_NEG";
-        case MC_ENABLE_CORDWRAP:
-            return "MC_ENABLE_CORDWRAP";
-        case MC_DISABLE_CORDWRAP:
-            return "MC_DISABLE_CORDWRAP";
-        case MC_SET_CORDWRAP_POS:
-            return "MC_SET_CORDWRAP_POS";
-        case MC_POLL_CORDWRAP:
-            return "MC_POLL_CORDWRAP";
-        case MC_GET_CORDWRAP_POS:
-            return "MC_GET_CORDWRAP_POS";
-        case GET_VER:
-            return "GET_VER";
-        default:
-            return nullptr;
-        }
+
+    int i = auxCommandIndex(c);
+    return i < 0 ? nullptr : AUX_COMMAND_TABLE[i].name;
 }
 
-int AUXCommand::response_data_size()
+int AUXCommand::response_data_size() const
 {
     if (src == GPS || dst == GPS)
         return -1;
-    else
-        switch (cmd)
-        {
-        case MC_GET_POSITION:
-        case MC_GET_CORDWRAP_POS:
-            return 3;
-        case GET_VER:
-            return 4;
-        case MC_SLEW_DONE:
-        case MC_POLL_CORDWRAP:
-            return 1;
-        case MC_GOTO_FAST:
-        case MC_SET_POSITION:
-        case MC_SET_POS_GUIDERATE:
-        case MC_SET_NEG_GUIDERATE:
-        case MC_LEVEL_START:
-        case MC_GOTO_SLOW:
-        case MC_MOVE_POS:
-        case MC_MOVE_NEG:
-        case MC_ENABLE_CORDWRAP:
-        case MC_DISABLE_CORDWRAP:
-        case MC_SET_CORDWRAP_POS:
-            return 0;
-        case MC_SEEK_INDEX:
-            return -1;
-        default:
-            return -1;
-        }
+
+    int i = auxCommandIndex(cmd);
+    return i < 0 ? -1 : AUX_COMMAND_TABLE[i].responseSize;
 }
 
 const char *AUXCommand::node_name(AUXtargets n)
 {
-    switch (n)
-    {
-    case ANY:
-        return "ANY";
-    case MB:
-        return "MB";
-    case HC:
-        return "HC";
-    case HCP:
-        return "HC+";
-    case AZM:
-        return "AZM";
-    case ALT:
-        return "ALT";
-    case APP:
-        return "APP";
-    case GPS:
-        return "GPS";
-    case WiFi:
-        return "WiFi";
-    case BAT:
-        return "BAT";
-    case CHG:
-        return "CHG";
-    case LIGHT:
-        return "LIGHT";
-    default:
-        return nullptr;
-    }
+    int i = auxNodeIndex(n);
+    return i < 0 ? nullptr : AUX_NODE_TABLE[i].name;
 }
 
-void AUXCommand::pprint()
+void AUXCommand::pprint() const
 {
     const char *c = cmd_name(cmd);
     const char *s = node_name(src);
@@ -222,7 +132,7 @@ void AUXCommand::pprint()
     fprintf(stderr, "]\n");
 }
 
-void AUXCommand::fillBuf(buffer &buf)
+void AUXCommand::fillBuf(buffer &buf) const
 {
     buf.resize(len + 3);
     buf[0] = 0x3b;
@@ -238,13 +148,13 @@ void AUXCommand::fillBuf(buffer &buf)
     // dumpMsg(buf);
 }
 
-void AUXCommand::parseBuf(buffer buf)
+void AUXCommand::parseBuf(const buffer &buf)
 {
     len   = buf[1];
     src   = (AUXtargets)buf[2];
     dst   = (AUXtargets)buf[3];
     cmd   = (AUXCommands)buf[4];
-    data  = buffer(buf.begin() + 5, buf.end() - 1);
+    data.assign(buf.begin() + 5, buf.end() - 1);
     valid = (checksum(buf) == buf.back());
     if (not valid)
     {
@@ -253,7 +163,7 @@ void AUXCommand::parseBuf(buffer buf)
     };
 }
 
-void AUXCommand::parseBuf(buffer buf, bool do_checksum)
+void AUXCommand::parseBuf(const buffer &buf, bool do_checksum)
 {
     (void)do_checksum;
 
@@ -262,10 +172,10 @@ void AUXCommand::parseBuf(buffer buf, bool do_checksum)
     dst = (AUXtargets)buf[3];
     cmd = (AUXCommands)buf[4];
     if (buf.size() > 5)
-        data = buffer(buf.begin() + 5, buf.end());
+        data.assign(buf.begin() + 5, buf.end());
 }
 
-unsigned char AUXCommand::checksum(buffer buf)
+unsigned char AUXCommand::checksum(const buffer &buf)
 {
     int l  = buf[1];
     int cs = 0;
@@ -284,7 +194,7 @@ unsigned char AUXCommand::checksum(buffer buf)
 const long STEPS_PER_REVOLUTION = 16777216;
 const double STEPS_PER_DEGREE   = STEPS_PER_REVOLUTION / 360.0;
 
-long AUXCommand::getPosition()
+long AUXCommand::getPosition() const
 {
     if (data.size() == 3)
     {
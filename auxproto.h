@@ -1,82 +1,360 @@
 #pragma once
 
+#include <initializer_list>
+#include <stddef.h>
 #include <stdint.h>
-#include <vector>
+#include <string.h>
 
-typedef std::vector<unsigned char> buffer;
+/*
+Fixed capacity byte buffer with the bits of std::vector's interface the AUX code uses. No AUX frame
+is longer than CAPACITY bytes, so keeping the bytes inline means building, sending and decoding a
+command never touches the heap.
+*/
+class AUXBuffer
+{
+  public:
+    static const size_t CAPACITY = 32;
+
+    typedef unsigned char value_type;
+    typedef unsigned char *iterator;
+    typedef const unsigned char *const_iterator;
+
+    AUXBuffer()
+    {
+    }
+    explicit AUXBuffer(size_t n)
+    {
+        resize(n);
+    }
+    AUXBuffer(const unsigned char *first, const unsigned char *last)
+    {
+        assign(first, last);
+    }
+    AUXBuffer(std::initializer_list<unsigned char> bytes)
+    {
+        assign(bytes.begin(), bytes.end());
+    }
+
+    void assign(const unsigned char *first, const unsigned char *last)
+    {
+        m_size = last > first ? clamp(last - first) : 0;
+        memcpy(m_data, first, m_size);
+    }
+
+    // New bytes are zeroed. Anything past CAPACITY is dropped.
+    void resize(size_t n)
+    {
+        n = clamp(n);
+        if (n > m_size)
+            memset(m_data + m_size, 0, n - m_size);
+        m_size = n;
+    }
+
+    void push_back(unsigned char b)
+    {
+        if (m_size < CAPACITY)
+            m_data[m_size++] = b;
+    }
+
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    unsigned char &operator[](size_t i)
+    {
+        return m_data[i];
+    }
+    unsigned char operator[](size_t i) const
+    {
+        return m_data[i];
+    }
+    unsigned char &back()
+    {
+        return m_data[m_size - 1];
+    }
+    unsigned char back() const
+    {
+        return m_data[m_size - 1];
+    }
+
+    unsigned char *data()
+    {
+        return m_data;
+    }
+    const unsigned char *data() const
+    {
+        return m_data;
+    }
+
+    iterator begin()
+    {
+        return m_data;
+    }
+    iterator end()
+    {
+        return m_data + m_size;
+    }
+    const_iterator begin() const
+    {
+        return m_data;
+    }
+    const_iterator end() const
+    {
+        return m_data + m_size;
+    }
+
+  private:
+    static size_t clamp(size_t n)
+    {
+        return n < CAPACITY ? n : CAPACITY;
+    }
+
+    unsigned char m_data[CAPACITY];
+    size_t m_size{0};
+};
+
+typedef AUXBuffer buffer;
+
+// Payload size that depends on the arguments, e.g. MC_SET_POS_GUIDERATE takes 2 or 3 bytes.
+#define AUX_VARIABLE_SIZE -1
+
+// Which nodes a command is meant for.
+#define AUX_FOR_MC 0x01
+#define AUX_FOR_ALL 0xff
+
+/*
+Every AUX command the driver knows about:
+    name, command id, request payload bytes, response payload bytes, nodes it is valid for.
+
+The AUXCommands enum and the descriptor table are both generated from this list, so a command
+can't exist without its sizes and name.
+*/
+#define AUX_COMMANDS(X)                                                        \
+    X(MC_GET_POSITION, 0x01, 0, 3, AUX_FOR_MC)                                 \
+    X(MC_GOTO_FAST, 0x02, 3, 0, AUX_FOR_MC)                                    \
+    X(MC_SET_POSITION, 0x04, 3, 0, AUX_FOR_MC)                                 \
+    X(MC_SET_POS_GUIDERATE, 0x06, AUX_VARIABLE_SIZE, 0, AUX_FOR_MC)            \
+    X(MC_SET_NEG_GUIDERATE, 0x07, AUX_VARIABLE_SIZE, 0, AUX_FOR_MC)            \
+    X(MC_LEVEL_START, 0x0b, 0, 0, AUX_FOR_MC)                                  \
+    X(MC_LEVEL_DONE, 0x12, 0, 1, AUX_FOR_MC)                                   \
+    X(MC_SLEW_DONE, 0x13, 0, 1, AUX_FOR_MC)                                    \
+    X(MC_GOTO_SLOW, 0x17, 3, 0, AUX_FOR_MC)                                    \
+    X(MC_AT_INDEX, 0x18, 0, 1, AUX_FOR_MC)                                     \
+    X(MC_SEEK_INDEX, 0x19, 0, 0, AUX_FOR_MC)                                   \
+    X(MC_MOVE_POS, 0x24, 1, 0, AUX_FOR_MC)                                     \
+    X(MC_MOVE_NEG, 0x25, 1, 0, AUX_FOR_MC)                                     \
+    X(MC_AUX_GUIDE, 0x26, 2, 0, AUX_FOR_MC)                                    \
+    X(MC_AUX_GUIDE_ACTIVE, 0x27, 0, 1, AUX_FOR_MC)                             \
+    X(MC_ENABLE_CORDWRAP, 0x38, 0, 0, AUX_FOR_MC)                              \
+    X(MC_DISABLE_CORDWRAP, 0x39, 0, 0, AUX_FOR_MC)                             \
+    X(MC_SET_CORDWRAP_POS, 0x3a, 3, 0, AUX_FOR_MC)                             \
+    X(MC_POLL_CORDWRAP, 0x3b, 0, 1, AUX_FOR_MC)                                \
+    X(MC_GET_CORDWRAP_POS, 0x3c, 0, 3, AUX_FOR_MC)                             \
+    X(MC_SET_AUTOGUIDE_RATE, 0x46, 1, 0, AUX_FOR_MC)                           \
+    X(MC_GET_AUTOGUIDE_RATE, 0x47, 0, 1, AUX_FOR_MC)                           \
+    X(GET_VER, 0xfe, 0, AUX_VARIABLE_SIZE, AUX_FOR_ALL)
+
+// name, address, printable name
+#define AUX_NODES(X)         \
+    X(ANY, 0x00, "ANY")      \
+    X(MB, 0x01, "MB")        \
+    X(HC, 0x04, "HC")        \
+    X(HCP, 0x0d, "HC+")      \
+    X(AZM, 0x10, "AZM")      \
+    X(ALT, 0x11, "ALT")      \
+    X(APP, 0x20, "APP")      \
+    X(GPS, 0xb0, "GPS")      \
+    X(WiFi, 0xb5, "WiFi")    \
+    X(BAT, 0xb6, "BAT")      \
+    X(CHG, 0xb7, "CHG")      \
+    X(LIGHT, 0xbf, "LIGHT")
+
+#define AUX_ENUM_COMMAND(name, id, request, response, targets) name = id,
+#define AUX_ENUM_NODE(name, address, label) name = address,
 
 enum AUXCommands
 {
-    MC_GET_POSITION       = 0x01,
-    MC_GOTO_FAST          = 0x02,
-    MC_SET_POSITION       = 0x04,
-    MC_SET_POS_GUIDERATE  = 0x06,
-    MC_SET_NEG_GUIDERATE  = 0x07,
-    MC_LEVEL_START        = 0x0b,
-    MC_LEVEL_DONE         = 0x12,
-    MC_SLEW_DONE          = 0x13,
-    MC_GOTO_SLOW          = 0x17,
-    MC_AT_INDEX           = 0x18,
-    MC_SEEK_INDEX         = 0x19,
-    MC_MOVE_POS           = 0x24,
-    MC_MOVE_NEG           = 0x25,
-    MC_AUX_GUIDE          = 0x26,
-    MC_AUX_GUIDE_ACTIVE   = 0x27,
-    MC_ENABLE_CORDWRAP    = 0x38,
-    MC_DISABLE_CORDWRAP   = 0x39,
-    MC_SET_CORDWRAP_POS   = 0x3a,
-    MC_POLL_CORDWRAP      = 0x3b,
-    MC_GET_CORDWRAP_POS   = 0x3c,
-    MC_SET_AUTOGUIDE_RATE = 0x46,
-    MC_GET_AUTOGUIDE_RATE = 0x47,
-    GET_VER               = 0xfe,
+    AUX_COMMANDS(AUX_ENUM_COMMAND)
 };
 
 enum AUXtargets
 {
-    ANY   = 0x00,
-    MB    = 0x01,
-    HC    = 0x04,
-    HCP   = 0x0d,
-    AZM   = 0x10,
-    ALT   = 0x11,
-    RA    = 0x10,
-    DEC   = 0x11,
-    APP   = 0x20,
-    GPS   = 0xb0,
-    WiFi  = 0xb5,
-    BAT   = 0xb6,
-    CHG   = 0xb7,
-    LIGHT = 0xbf
+    AUX_NODES(AUX_ENUM_NODE)
+    // On an equatorial mount the azimuth and altitude motors drive RA and DEC.
+    RA  = AZM,
+    DEC = ALT
+};
+
+#undef AUX_ENUM_COMMAND
+#undef AUX_ENUM_NODE
+
+struct AUXCommandDescriptor
+{
+    AUXCommands cmd;
+    const char *name;
+    int requestSize;
+    int responseSize;
+    unsigned char targets;
+};
+
+struct AUXNodeDescriptor
+{
+    AUXtargets node;
+    const char *name;
+};
+
+#define AUX_DESCRIBE_COMMAND(name, id, request, response, targets) \
+    { name, #name, request, response, targets },
+#define AUX_DESCRIBE_NODE(name, address, label) { name, label },
+
+constexpr AUXCommandDescriptor AUX_COMMAND_TABLE[] = { AUX_COMMANDS(AUX_DESCRIBE_COMMAND) };
+constexpr AUXNodeDescriptor AUX_NODE_TABLE[]       = { AUX_NODES(AUX_DESCRIBE_NODE) };
+
+#undef AUX_DESCRIBE_COMMAND
+#undef AUX_DESCRIBE_NODE
+
+constexpr int AUX_COMMAND_COUNT = sizeof(AUX_COMMAND_TABLE) / sizeof(AUX_COMMAND_TABLE[0]);
+constexpr int AUX_NODE_COUNT    = sizeof(AUX_NODE_TABLE) / sizeof(AUX_NODE_TABLE[0]);
+
+// Index of the command in AUX_COMMAND_TABLE, or -1. Usable in constant expressions.
+constexpr int auxCommandIndex(int cmd, int i = 0)
+{
+    return i >= AUX_COMMAND_COUNT
+               ? -1
+               : (AUX_COMMAND_TABLE[i].cmd == cmd ? i : auxCommandIndex(cmd, i + 1));
+}
+
+constexpr int auxNodeIndex(int node, int i = 0)
+{
+    return i >= AUX_NODE_COUNT ? -1
+                               : (AUX_NODE_TABLE[i].node == node ? i : auxNodeIndex(node, i + 1));
+}
+
+constexpr bool auxIsMotorController(int node)
+{
+    return node == AZM || node == ALT;
+}
+
+constexpr bool auxCommandValidFor(int cmd, int node)
+{
+    return auxCommandIndex(cmd) >= 0 &&
+           (AUX_COMMAND_TABLE[auxCommandIndex(cmd)].targets == AUX_FOR_ALL ||
+            ((AUX_COMMAND_TABLE[auxCommandIndex(cmd)].targets & AUX_FOR_MC) &&
+             auxIsMotorController(node)));
+}
+
+/*
+Compile time facts about one command. Naming a command that has no row in AUX_COMMANDS fails the
+build here rather than turning into a -1 at runtime.
+*/
+template <AUXCommands C>
+struct AUXCommandTraits
+{
+    static_assert(auxCommandIndex(C) >= 0, "AUX command is missing from AUX_COMMANDS");
+
+    static constexpr int requestSize  = AUX_COMMAND_TABLE[auxCommandIndex(C)].requestSize;
+    static constexpr int responseSize = AUX_COMMAND_TABLE[auxCommandIndex(C)].responseSize;
+    // Start byte, length, src, dst, cmd, payload and checksum.
+    static constexpr int requestFrameSize = 6 + requestSize;
 };
 
-void prnBytes(unsigned char *b, int n);
-void dumpMsg(buffer buf);
+void prnBytes(const unsigned char *b, int n);
+void dumpMsg(const buffer &buf);
 
 class AUXCommand
 {
   public:
     AUXCommand();
-    AUXCommand(buffer buf);
-    AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d, buffer dat);
+    explicit AUXCommand(const buffer &buf);
+    AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d, const buffer &dat);
     AUXCommand(AUXCommands c, AUXtargets s, AUXtargets d);
 
-    void fillBuf(buffer &buf);
-    void parseBuf(buffer buf);
-    void parseBuf(buffer buf, bool do_checksum);
-    long getPosition();
+    void fillBuf(buffer &buf) const;
+    void parseBuf(const buffer &buf);
+    void parseBuf(const buffer &buf, bool do_checksum);
+    long getPosition() const;
     void setPosition(uint32_t p);
     void setRate(unsigned char r);
-    unsigned char checksum(buffer buf);
-    void dumpCmd();
-    const char *cmd_name(AUXCommands c);
-    int response_data_size();
-    const char *node_name(AUXtargets n);
-    void pprint();
+    static unsigned char checksum(const buffer &buf);
+    void dumpCmd() const;
+    const char *cmd_name(AUXCommands c) const;
+    int response_data_size() const;
+    static const char *node_name(AUXtargets n);
+    void pprint() const;
 
-    AUXCommands cmd;
-    AUXtargets src, dst;
-    int len;
+    AUXCommands cmd{GET_VER};
+    AUXtargets src{ANY}, dst{ANY};
+    int len{3};
     buffer data;
-    bool valid;
+    bool valid{false};
 };
+
+/*
+Typed encode/decode helpers. The payload and reply sizes, and whether the node understands the
+command, are checked against AUX_COMMANDS when the template is instantiated, so a mismatch is a
+compile error and the runtime path is just the byte shuffling.
+*/
+template <AUXCommands C, AUXtargets D>
+AUXCommand auxQuery()
+{
+    static_assert(AUXCommandTraits<C>::requestSize == 0, "command takes a payload");
+    static_assert(auxCommandValidFor(C, D), "command is not valid for this node");
+
+    return AUXCommand(C, ANY, D);
+}
+
+template <AUXCommands C, AUXtargets D>
+AUXCommand auxPositionCommand(uint32_t steps)
+{
+    static_assert(AUXCommandTraits<C>::requestSize == 3, "command does not take a position");
+    static_assert(auxCommandValidFor(C, D), "command is not valid for this node");
+
+    AUXCommand cmd(C, ANY, D);
+    cmd.setPosition(steps);
+    return cmd;
+}
+
+template <AUXCommands C, AUXtargets D>
+AUXCommand auxRateCommand(unsigned char rate)
+{
+    static_assert(AUXCommandTraits<C>::requestSize == 1, "command does not take a rate");
+    static_assert(auxCommandValidFor(C, D), "command is not valid for this node");
+
+    AUXCommand cmd(C, ANY, D);
+    cmd.setRate(rate);
+    return cmd;
+}
+
+template <AUXCommands C>
+bool auxDecodePosition(const AUXCommand &reply, uint32_t &steps)
+{
+    static_assert(AUXCommandTraits<C>::responseSize == 3, "reply does not carry a position");
+
+    if (reply.cmd != C || reply.data.size() != AUXCommandTraits<C>::responseSize)
+        return false;
+
+    steps = (uint32_t)reply.data[0] << 16 | (uint32_t)reply.data[1] << 8 | (uint32_t)reply.data[2];
+    return true;
+}
+
+template <AUXCommands C>
+bool auxDecodeByte(const AUXCommand &reply, unsigned char &value)
+{
+    static_assert(AUXCommandTraits<C>::responseSize == 1, "reply does not carry a single byte");
+
+    if (reply.cmd != C || reply.data.size() != AUXCommandTraits<C>::responseSize)
+        return false;
+
+    value = reply.data[0];
+    return true;
+}
@@ -0,0 +1,230 @@
+#include "auxreplay.h"
+
+#include <deque>
+#include <string.h>
+
+// Longer than any request's timeout on the bus; a request this old won't be matched any more.
+static const int64_t PENDING_NS = 2000000000LL;
+
+AUXReplay::AUXReplay()
+{
+    memset(&m_counts, 0, sizeof(m_counts));
+}
+
+bool AUXReplay::load(const std::string &path)
+{
+    AUXTraceReader reader;
+    return reader.open(path) && load(reader);
+}
+
+bool AUXReplay::load(AUXTraceReader &reader)
+{
+    struct Pending
+    {
+        int64_t offsetNs;
+        AUXCommand cmd;
+        bool echoed;
+    };
+
+    m_frames.clear();
+    m_replies.clear();
+    m_unsolicited.clear();
+    memset(&m_counts, 0, sizeof(m_counts));
+
+    AUXFrameDecoder fromDriver, fromMount;
+    std::deque<Pending> pending;
+    uint32_t echoes = 0;
+    int64_t start   = 0;
+    bool first      = true;
+
+    AUXTraceReader::Entry entry;
+    while (reader.next(entry))
+    {
+        if (first)
+        {
+            start = entry.timeNs;
+            first = false;
+        }
+
+        int64_t offset          = entry.timeNs - start;
+        AUXFrameDecoder &decoder = entry.direction == AUXTrace::TO_MOUNT ? fromDriver : fromMount;
+
+        const unsigned char *data = entry.bytes;
+        size_t left               = entry.length;
+        while (left > 0)
+        {
+            size_t accepted = decoder.feed(data, left);
+            data += accepted;
+            left -= accepted;
+
+            Frame frame;
+            frame.offsetNs  = offset;
+            frame.direction = entry.direction;
+
+            while (decoder.next(frame.cmd))
+            {
+                m_frames.push_back(frame);
+                const AUXCommand &cmd = frame.cmd;
+
+                if (entry.direction == AUXTrace::TO_MOUNT)
+                {
+                    Pending request = { offset, cmd, false };
+                    pending.push_back(request);
+                    m_counts.recordedRequests++;
+                    continue;
+                }
+
+                while (!pending.empty() && offset - pending.front().offsetNs > PENDING_NS)
+                    pending.pop_front();
+
+                // A request coming straight back is an echo; one with src and dst swapped is the
+                // reply. Oldest first, as on the bus.
+                bool matched = false;
+                for (std::deque<Pending>::iterator it = pending.begin(); it != pending.end(); ++it)
+                {
+                    if (it->cmd.cmd != cmd.cmd)
+                        continue;
+
+                    if (!it->echoed && it->cmd.src == cmd.src && it->cmd.dst == cmd.dst)
+                    {
+                        it->echoed = true;
+                        echoes++;
+                        matched = true;
+                        break;
+                    }
+
+                    if (it->cmd.dst == cmd.src && (it->cmd.src == cmd.dst || it->cmd.src == ANY))
+                    {
+                        buffer bytes;
+                        cmd.fillBuf(bytes);
+                        m_replies[key(cmd.cmd, cmd.src)].frames.push_back(bytes);
+                        m_counts.recordedReplies++;
+
+                        pending.erase(it);
+                        matched = true;
+                        break;
+                    }
+                }
+
+                if (!matched)
+                {
+                    Unsolicited unsolicited;
+                    unsolicited.offsetNs = offset;
+                    cmd.fillBuf(unsolicited.frame);
+                    m_unsolicited.push_back(unsolicited);
+                    m_counts.recordedUnsolicited++;
+                }
+            }
+        }
+
+        m_durationNs = offset;
+    }
+
+    m_echoes                = echoes * 2 > m_counts.recordedRequests;
+    m_counts.checksumErrors = fromMount.checksumErrors();
+    m_counts.resyncs        = fromMount.resyncs();
+    m_counts.dropped        = reader.dropped();
+
+    restart();
+    return !m_frames.empty();
+}
+
+void AUXReplay::restart()
+{
+    for (std::map<uint32_t, Replies>::iterator it = m_replies.begin(); it != m_replies.end(); ++it)
+        it->second.next = 0;
+
+    m_decoder.reset();
+    m_output.clear();
+    m_nextUnsolicited = 0;
+    m_elapsed         = 0;
+
+    m_counts.requests    = 0;
+    m_counts.replayed    = 0;
+    m_counts.repeated    = 0;
+    m_counts.unanswered  = 0;
+    m_counts.madeUp      = 0;
+    m_counts.unsolicited = 0;
+}
+
+void AUXReplay::receive(const unsigned char *data, size_t n)
+{
+    while (n > 0)
+    {
+        size_t accepted = m_decoder.feed(data, n);
+        data += accepted;
+        n -= accepted;
+
+        AUXCommand request;
+        while (m_decoder.next(request))
+        {
+            m_counts.requests++;
+
+            if (m_echoes)
+            {
+                buffer echo;
+                request.fillBuf(echo);
+                m_output.push_back(echo);
+            }
+
+            answer(request);
+        }
+    }
+}
+
+void AUXReplay::answer(const AUXCommand &request)
+{
+    std::map<uint32_t, Replies>::iterator it = m_replies.find(key(request.cmd, request.dst));
+
+    if (it == m_replies.end())
+    {
+        // The driver won't connect without the versions. A trace that wrapped has lost the
+        // connect it started with, so make them up rather than fail there.
+        if (request.cmd == GET_VER)
+        {
+            buffer reply;
+            AUXCommand(GET_VER, request.dst, request.src, buffer({ 7, 11 })).fillBuf(reply);
+            m_output.push_back(reply);
+            m_counts.madeUp++;
+            return;
+        }
+
+        m_counts.unanswered++;
+        return;
+    }
+
+    Replies &replies = it->second;
+    if (replies.next < replies.frames.size())
+    {
+        m_output.push_back(replies.frames[replies.next++]);
+        m_counts.replayed++;
+    }
+    else
+    {
+        m_output.push_back(replies.frames.back());
+        m_counts.repeated++;
+    }
+}
+
+void AUXReplay::advance(double seconds)
+{
+    m_elapsed += seconds;
+
+    int64_t now = static_cast<int64_t>(m_elapsed * 1e9);
+    while (m_nextUnsolicited < m_unsolicited.size() &&
+           m_unsolicited[m_nextUnsolicited].offsetNs <= now)
+    {
+        m_output.push_back(m_unsolicited[m_nextUnsolicited++].frame);
+        m_counts.unsolicited++;
+    }
+}
+
+bool AUXReplay::nextFrame(buffer &frame)
+{
+    if (m_output.empty())
+        return false;
+
+    frame = m_output.front();
+    m_output.pop_front();
+    return true;
+}
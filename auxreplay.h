@@ -0,0 +1,129 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "auxdecoder.h"
+#include "auxmount.h"
+#include "auxtrace.h"
+
+/*
+Plays a recorded AUX trace back as the mount, so the driver can be run against a night's real
+traffic: a stuck slew or a missed guide completion in the field happens again on the desk.
+
+load() decodes the trace and sorts what the mount sent into replies, matched to the request they
+answered the way AUXBus matches them, and unsolicited frames such as SLEW_DONE announcements.
+When played back, each request the driver sends gets the next recorded reply to the same command
+from the same node. Once those run out the last one is repeated, so a driver that polls more often
+than the recorded one sees the mount sitting still rather than going quiet. Unsolicited frames go
+out at their recorded offsets from the start of the trace, measured in advance() time, so
+advancing faster than real time replays the night faster.
+
+What the driver asked for makes no difference to what comes back. A goto to somewhere else still
+gets the recorded slew, which is the point: the driver's side of the conversation is what's under
+test.
+*/
+class AUXReplay : public AUXMount
+{
+  public:
+    struct Frame
+    {
+        // Nanoseconds since the first record in the trace.
+        int64_t offsetNs;
+        AUXTrace::Direction direction;
+        AUXCommand cmd;
+    };
+
+    AUXReplay();
+
+    // Decodes everything live in the trace. Returns false if the trace has no frames in it.
+    bool load(AUXTraceReader &reader);
+    bool load(const std::string &path);
+
+    // Every decoded frame in both directions, in the order they hit the wire.
+    const std::vector<Frame> &frames() const
+    {
+        return m_frames;
+    }
+    double duration() const
+    {
+        return m_durationNs / 1e9;
+    }
+
+    // Starts playback over from the beginning of the trace.
+    void restart();
+
+    virtual void receive(const unsigned char *data, size_t n) override;
+    virtual void advance(double seconds) override;
+    virtual bool nextFrame(buffer &frame) override;
+
+    // All the unsolicited frames have gone out.
+    bool finished() const
+    {
+        return m_nextUnsolicited == m_unsolicited.size();
+    }
+
+    struct Counts
+    {
+        // From loading the trace.
+        uint32_t recordedRequests;
+        uint32_t recordedReplies;
+        uint32_t recordedUnsolicited;
+        uint32_t checksumErrors;
+        uint32_t resyncs;
+        uint64_t dropped;
+        // From playback.
+        uint32_t requests;
+        uint32_t replayed;
+        uint32_t repeated;
+        uint32_t unanswered;
+        // Versions invented for a trace that lost its connect.
+        uint32_t madeUp;
+        uint32_t unsolicited;
+    };
+
+    const Counts &counts() const
+    {
+        return m_counts;
+    }
+
+  private:
+    // Replies are filed by command and the node that sent them, which is who the request went to.
+    static uint32_t key(AUXCommands cmd, AUXtargets from)
+    {
+        return (static_cast<uint32_t>(cmd) & 0xff) << 8 | (static_cast<uint32_t>(from) & 0xff);
+    }
+
+    struct Replies
+    {
+        std::vector<buffer> frames;
+        size_t next{0};
+    };
+
+    struct Unsolicited
+    {
+        int64_t offsetNs;
+        buffer frame;
+    };
+
+    void answer(const AUXCommand &request);
+
+    std::vector<Frame> m_frames;
+    int64_t m_durationNs{0};
+
+    std::map<uint32_t, Replies> m_replies;
+    std::vector<Unsolicited> m_unsolicited;
+    // The recorded mount echoed requests back, as some serial adapters do.
+    bool m_echoes{false};
+
+    AUXFrameDecoder m_decoder;
+    std::deque<buffer> m_output;
+    size_t m_nextUnsolicited{0};
+    double m_elapsed{0};
+
+    Counts m_counts;
+};
@@ -0,0 +1,402 @@
+#include "auxsimulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+const uint32_t AUXSimulator::STEPS_PER_REVOLUTION;
+
+static const double STEPS            = AUXSimulator::STEPS_PER_REVOLUTION;
+static const double STEPS_PER_DEGREE = STEPS / 360.0;
+static const double SIDEREAL_RATE    = STEPS / 86164.0905;
+
+static const double GOTO_FAST_RATE = 4.0 * STEPS_PER_DEGREE;
+static const double GOTO_SLOW_RATE = 0.5 * STEPS_PER_DEGREE;
+static const double ACCELERATION   = 2.0 * STEPS_PER_DEGREE;
+
+// Hand controller rates 1-9: multiples of sidereal, then degrees per second.
+static const double MOVE_RATES[10] = {
+    0,
+    2 * SIDEREAL_RATE,
+    4 * SIDEREAL_RATE,
+    8 * SIDEREAL_RATE,
+    16 * SIDEREAL_RATE,
+    32 * SIDEREAL_RATE,
+    0.5 * STEPS_PER_DEGREE,
+    1.0 * STEPS_PER_DEGREE,
+    2.0 * STEPS_PER_DEGREE,
+    4.0 * STEPS_PER_DEGREE,
+};
+
+// Largest time step the motion is integrated over.
+static const double MAX_STEP_SECONDS = 0.01;
+
+static double wrapSteps(double steps)
+{
+    steps = std::fmod(steps, STEPS);
+    return steps < 0 ? steps + STEPS : steps;
+}
+
+// Shortest signed distance from b to a.
+static double shortest(double a, double b)
+{
+    double d = wrapSteps(a - b);
+    return d > STEPS / 2 ? d - STEPS : d;
+}
+
+static uint32_t decodePosition(const buffer &data)
+{
+    return data[0] << 16 | data[1] << 8 | data[2];
+}
+
+static buffer encodePosition(double steps)
+{
+    uint32_t p = static_cast<uint32_t>(wrapSteps(std::floor(steps)));
+    return buffer({ static_cast<unsigned char>(p >> 16), static_cast<unsigned char>(p >> 8),
+                    static_cast<unsigned char>(p) });
+}
+
+AUXSimulator::AUXSimulator()
+{
+    m_ra.node  = RA;
+    m_dec.node = DEC;
+
+    // Somewhere other than the home position the driver sets after homing, so homing matters.
+    setIndexPosition(RA, STEPS_PER_REVOLUTION / 4 + 12345);
+    setIndexPosition(DEC, STEPS_PER_REVOLUTION / 2 - 54321);
+}
+
+void AUXSimulator::setIndexPosition(AUXtargets axis, uint32_t steps)
+{
+    Motor *m = motor(axis);
+    if (m == nullptr)
+        return;
+
+    m->indexPosition = steps % STEPS_PER_REVOLUTION;
+}
+
+void AUXSimulator::receive(const unsigned char *data, size_t n)
+{
+    while (n > 0)
+    {
+        size_t accepted = m_decoder.feed(data, n);
+        data += accepted;
+        n -= accepted;
+
+        AUXCommand cmd;
+        while (m_decoder.next(cmd))
+        {
+            if (cmd.valid)
+                handle(cmd);
+            else
+                m_rejected++;
+        }
+    }
+}
+
+void AUXSimulator::advance(double seconds)
+{
+    while (seconds > 0)
+    {
+        double dt = std::min(seconds, MAX_STEP_SECONDS);
+
+        step(m_ra, dt);
+        step(m_dec, dt);
+
+        seconds -= dt;
+    }
+}
+
+bool AUXSimulator::nextFrame(buffer &frame)
+{
+    if (m_output.empty())
+        return false;
+
+    frame = m_output.front();
+    m_output.pop_front();
+    return true;
+}
+
+uint32_t AUXSimulator::position(AUXtargets axis) const
+{
+    const Motor *m = motor(axis);
+    return m == nullptr ? 0 : static_cast<uint32_t>(m->position);
+}
+
+bool AUXSimulator::slewing(AUXtargets axis) const
+{
+    const Motor *m = motor(axis);
+    return m != nullptr && m->mode != IDLE;
+}
+
+AUXSimulator::Motor *AUXSimulator::motor(AUXtargets node)
+{
+    return node == RA ? &m_ra : node == DEC ? &m_dec : nullptr;
+}
+
+const AUXSimulator::Motor *AUXSimulator::motor(AUXtargets node) const
+{
+    return node == RA ? &m_ra : node == DEC ? &m_dec : nullptr;
+}
+
+void AUXSimulator::handle(const AUXCommand &cmd)
+{
+    if (cmd.cmd == GET_VER && cmd.dst == MB)
+    {
+        reply(cmd, buffer({ 7, 11 }));
+        return;
+    }
+
+    Motor *m = motor(cmd.dst);
+    if (m == nullptr)
+    {
+        // Nobody at that address; a real bus stays quiet too.
+        return;
+    }
+
+    switch (cmd.cmd)
+    {
+    case GET_VER:
+        reply(cmd, buffer({ 7, 19 }));
+        return;
+
+    case MC_GET_POSITION:
+        reply(cmd, encodePosition(m->position));
+        return;
+
+    case MC_SET_POSITION:
+        if (cmd.data.size() != 3)
+            break;
+        // The index mark stays where it physically is, so it moves on the new encoder scale.
+        m->indexPosition = static_cast<uint32_t>(
+            wrapSteps(m->indexPosition + decodePosition(cmd.data) - m->position));
+        m->position = decodePosition(cmd.data);
+        reply(cmd, buffer());
+        return;
+
+    case MC_GOTO_FAST:
+    case MC_GOTO_SLOW:
+        if (cmd.data.size() != 3)
+            break;
+        startGoto(*m, decodePosition(cmd.data), cmd.cmd == MC_GOTO_FAST, cmd.src);
+        reply(cmd, buffer());
+        return;
+
+    case MC_SLEW_DONE:
+        reply(cmd, buffer({ static_cast<unsigned char>(m->mode == GOTO ? 0x00 : 0xff) }));
+        return;
+
+    case MC_MOVE_POS:
+    case MC_MOVE_NEG:
+    {
+        if (cmd.data.size() != 1)
+            break;
+
+        int rate = std::min<int>(cmd.data[0], 9);
+        if (rate == 0)
+        {
+            // Stops a goto or index search too; it's how the driver aborts a slew.
+            m->mode = IDLE;
+        }
+        else
+        {
+            m->mode     = MOVE;
+            m->moveRate = (cmd.cmd == MC_MOVE_POS ? 1 : -1) * MOVE_RATES[rate];
+        }
+        reply(cmd, buffer());
+        return;
+    }
+
+    case MC_SET_POS_GUIDERATE:
+    case MC_SET_NEG_GUIDERATE:
+    {
+        double rate;
+        if (cmd.data.size() == 2 && cmd.data[0] == 0xff)
+        {
+            // 0xffff sidereal, 0xfffe solar, 0xfffd lunar.
+            rate = cmd.data[1] == 0xfe ? STEPS / 86400.0
+                                       : cmd.data[1] == 0xfd ? STEPS / 89428.3 : SIDEREAL_RATE;
+        }
+        else if (cmd.data.size() == 3)
+        {
+            // Units of 1/1024 arcsecond per second.
+            rate = decodePosition(cmd.data) / 1024.0 / 3600.0 * STEPS_PER_DEGREE;
+        }
+        else
+        {
+            break;
+        }
+
+        m->trackRate = cmd.cmd == MC_SET_POS_GUIDERATE ? rate : -rate;
+        reply(cmd, buffer());
+        return;
+    }
+
+    case MC_AUX_GUIDE:
+        if (cmd.data.size() != 2)
+            break;
+        m->guideRate = static_cast<int8_t>(cmd.data[0]) / 100.0 * SIDEREAL_RATE;
+        m->guideLeft = cmd.data[1] * 0.01;
+        reply(cmd, buffer());
+        return;
+
+    case MC_AUX_GUIDE_ACTIVE:
+        reply(cmd, buffer({ static_cast<unsigned char>(m->guideLeft > 0 ? 0x01 : 0x00) }));
+        return;
+
+    case MC_SET_AUTOGUIDE_RATE:
+        if (cmd.data.size() != 1)
+            break;
+        m->autoguideRate = cmd.data[0];
+        reply(cmd, buffer());
+        return;
+
+    case MC_GET_AUTOGUIDE_RATE:
+        reply(cmd, buffer({ m->autoguideRate }));
+        return;
+
+    case MC_LEVEL_START:
+    case MC_SEEK_INDEX:
+        startGoto(*m, m->indexPosition, true, cmd.src);
+        m->mode    = LEVEL;
+        m->leveled = false;
+        reply(cmd, buffer());
+        return;
+
+    case MC_LEVEL_DONE:
+        reply(cmd, buffer({ static_cast<unsigned char>(
+                       m->leveled && m->mode != LEVEL ? 0xff : 0x00) }));
+        return;
+
+    case MC_AT_INDEX:
+        reply(cmd, buffer({ static_cast<unsigned char>(
+                       std::fabs(shortest(m->position, m->indexPosition)) < 1 ? 0xff : 0x00) }));
+        return;
+
+    case MC_ENABLE_CORDWRAP:
+        m->cordwrap = true;
+        reply(cmd, buffer());
+        return;
+
+    case MC_DISABLE_CORDWRAP:
+        m->cordwrap = false;
+        reply(cmd, buffer());
+        return;
+
+    case MC_SET_CORDWRAP_POS:
+        if (cmd.data.size() != 3)
+            break;
+        m->cordwrapPosition = decodePosition(cmd.data);
+        reply(cmd, buffer());
+        return;
+
+    case MC_POLL_CORDWRAP:
+        reply(cmd, buffer({ static_cast<unsigned char>(m->cordwrap ? 0xff : 0x00) }));
+        return;
+
+    case MC_GET_CORDWRAP_POS:
+        reply(cmd, encodePosition(m->cordwrapPosition));
+        return;
+    }
+
+    m_rejected++;
+}
+
+void AUXSimulator::reply(const AUXCommand &request, const buffer &data)
+{
+    AUXCommand response(request.cmd, request.dst, request.src, data);
+
+    buffer frame;
+    response.fillBuf(frame);
+    m_output.push_back(frame);
+}
+
+void AUXSimulator::announce(const Motor &m, AUXCommands cmd)
+{
+    AUXCommand event(cmd, m.node, m.requester);
+
+    buffer frame;
+    event.fillBuf(frame);
+    m_output.push_back(frame);
+}
+
+void AUXSimulator::startGoto(Motor &m, uint32_t target, bool fast, AUXtargets requester)
+{
+    m.mode      = GOTO;
+    m.target    = target % STEPS_PER_REVOLUTION;
+    m.remaining = shortest(m.target, m.position);
+    m.maxRate   = fast ? GOTO_FAST_RATE : GOTO_SLOW_RATE;
+    m.requester = requester;
+
+    if (m.cordwrap)
+    {
+        // Distance to the cordwrap position in the direction we'd turn.
+        double toWrap = wrapSteps(m.remaining >= 0 ? m.cordwrapPosition - m.position
+                                                   : m.position - m.cordwrapPosition);
+        if (toWrap > 0 && toWrap < std::fabs(m.remaining))
+        {
+            m.remaining += m.remaining >= 0 ? -STEPS : STEPS;
+        }
+    }
+}
+
+void AUXSimulator::step(Motor &m, double dt)
+{
+    switch (m.mode)
+    {
+    case GOTO:
+    case LEVEL:
+    {
+        double direction = m.remaining >= 0 ? 1 : -1;
+        double distance  = std::fabs(m.remaining);
+
+        // Accelerate, but never faster than we can brake from before reaching the target.
+        double speed = std::max(0.0, m.velocity * direction) + ACCELERATION * dt;
+        speed        = std::min(speed, std::min(m.maxRate, std::sqrt(2 * ACCELERATION * distance)));
+        speed        = std::max(speed, ACCELERATION * dt);
+
+        if (speed * dt >= distance)
+        {
+            m.position = m.target;
+            m.velocity = 0;
+
+            if (m.mode == LEVEL)
+            {
+                m.leveled = true;
+                m.mode    = IDLE;
+                announce(m, MC_LEVEL_DONE);
+            }
+            else
+            {
+                m.mode = IDLE;
+                announce(m, MC_SLEW_DONE);
+            }
+            return;
+        }
+
+        m.position = wrapSteps(m.position + direction * speed * dt);
+        m.remaining -= direction * speed * dt;
+        m.velocity = direction * speed;
+        return;
+    }
+
+    case MOVE:
+        m.velocity = m.moveRate;
+        break;
+
+    case IDLE:
+    {
+        m.velocity = m.trackRate;
+
+        // A pulse that ends part way through the step only counts for the part it was on.
+        double guided = std::min(dt, m.guideLeft);
+        if (guided > 0)
+        {
+            m.position = wrapSteps(m.position + m.guideRate * guided);
+            m.guideLeft -= guided;
+        }
+        break;
+    }
+    }
+
+    m.position = wrapSteps(m.position + m.velocity * dt);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "auxdecoder.h"
+#include "auxmount.h"
+#include "auxproto.h"
+
+/*
+Software stand-in for the CGX's two motor controllers and main board, for running the driver
+without a mount.
+
+Bytes the driver writes go in through receive() and replies come back out of nextFrame(); how the
+bytes travel (a pty, a pipe, a direct call) is up to the caller. Time only moves when advance() is
+called, so a caller can run the motors in real time or as fast as it likes.
+
+Each motor has an encoder that wraps at 2^24 steps and moves under gotos (accelerating up to the
+fast or slow goto rate and braking onto the target), manual moves at the hand controller rates,
+tracking at sidereal, solar, lunar or a custom rate, and autoguide pulses. MC_LEVEL_START drives
+the axis to its index mark. A goto on RA with the cordwrap enabled goes the long way round rather
+than across the cordwrap position. Gotos and index searches announce themselves with an
+unsolicited SLEW_DONE or LEVEL_DONE, as the real controllers do.
+*/
+class AUXSimulator : public AUXMount
+{
+  public:
+    static const uint32_t STEPS_PER_REVOLUTION = 0x1000000;
+
+    AUXSimulator();
+
+    // Where each axis' index mark is on its encoder at power on. The driver homes the axes with
+    // MC_LEVEL_START and then sets the encoders itself, so any value works.
+    void setIndexPosition(AUXtargets axis, uint32_t steps);
+
+    virtual void receive(const unsigned char *data, size_t n) override;
+    virtual void advance(double seconds) override;
+    virtual bool nextFrame(buffer &frame) override;
+
+    uint32_t position(AUXtargets axis) const;
+    bool slewing(AUXtargets axis) const;
+
+    // Frames the simulator didn't understand or that had a bad checksum.
+    uint32_t rejected() const
+    {
+        return m_rejected;
+    }
+
+  private:
+    enum Mode
+    {
+        IDLE,
+        GOTO,
+        MOVE,
+        LEVEL
+    };
+
+    struct Motor
+    {
+        AUXtargets node;
+        // Steps, kept fractional so slow rates accumulate.
+        double position{0};
+        double velocity{0};
+
+        Mode mode{IDLE};
+        double target{0};
+        // Signed distance left for the goto; lets the RA goto take the long way round.
+        double remaining{0};
+        double maxRate{0};
+        // Whoever started the goto or index search hears about its end.
+        AUXtargets requester{ANY};
+
+        double trackRate{0};
+        double moveRate{0};
+
+        double guideRate{0};
+        double guideLeft{0};
+        unsigned char autoguideRate{128};
+
+        uint32_t indexPosition{0};
+        bool leveled{false};
+
+        bool cordwrap{false};
+        uint32_t cordwrapPosition{0};
+    };
+
+    Motor *motor(AUXtargets node);
+    const Motor *motor(AUXtargets node) const;
+
+    void handle(const AUXCommand &cmd);
+    void reply(const AUXCommand &request, const buffer &data);
+    void announce(const Motor &m, AUXCommands cmd);
+
+    void startGoto(Motor &m, uint32_t target, bool fast, AUXtargets requester);
+    void step(Motor &m, double dt);
+
+    AUXFrameDecoder m_decoder;
+    std::deque<buffer> m_output;
+    Motor m_ra;
+    Motor m_dec;
+    uint32_t m_rejected{0};
+};
@@ -0,0 +1,204 @@
+#include "auxstats.h"
+
+#include <math.h>
+
+const int AUXStats::BUCKETS;
+const int AUXStats::ROWS;
+const int AUXStats::ALL;
+
+static const std::memory_order RELAXED = std::memory_order_relaxed;
+
+AUXStats::AUXStats()
+{
+    static_assert(AUX_COMMAND_COUNT < 128, "row index must fit the lookup table");
+
+    for (int i = 0; i < 256; i++)
+        m_rowOf[i] = -1;
+    for (int i = 0; i < AUX_COMMAND_COUNT; i++)
+        m_rowOf[AUX_COMMAND_TABLE[i].cmd & 0xff] = static_cast<int8_t>(i);
+
+    reset();
+}
+
+void AUXStats::reset()
+{
+    for (int r = 0; r < ROWS; r++)
+    {
+        for (int b = 0; b < BUCKETS; b++)
+            m_rows[r].buckets[b].store(0, RELAXED);
+        m_rows[r].replies.store(0, RELAXED);
+        m_rows[r].timeouts.store(0, RELAXED);
+    }
+
+    for (int l = 0; l < LANE_COUNT; l++)
+    {
+        for (int b = 0; b < BUCKETS; b++)
+            m_lanes[l].buckets[b].store(0, RELAXED);
+        m_lanes[l].skipped.store(0, RELAXED);
+    }
+
+    m_bytesOut.store(0, RELAXED);
+    m_bytesIn.store(0, RELAXED);
+    m_framesOut.store(0, RELAXED);
+    m_framesIn.store(0, RELAXED);
+    m_checksumErrors.store(0, RELAXED);
+    m_resyncs.store(0, RELAXED);
+}
+
+int AUXStats::bucketFor(uint64_t us)
+{
+    // 0-3 us get a bucket each; above that, four per power of two, split on the two bits below
+    // the top one.
+    if (us < 4)
+        return static_cast<int>(us);
+
+    int top    = 63 - __builtin_clzll(us);
+    int bucket = 4 * (top - 1) + static_cast<int>((us >> (top - 2)) & 3);
+
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+double AUXStats::bucketMidpoint(int bucket)
+{
+    if (bucket < 4)
+        return bucket;
+
+    int top      = bucket / 4 + 1;
+    double width = static_cast<double>(1 << (top - 2));
+    return (4 + bucket % 4) * width + width / 2;
+}
+
+void AUXStats::wrote(size_t bytes, uint32_t frames)
+{
+    m_bytesOut.fetch_add(bytes, RELAXED);
+    m_framesOut.fetch_add(frames, RELAXED);
+}
+
+void AUXStats::read(size_t bytes)
+{
+    m_bytesIn.fetch_add(bytes, RELAXED);
+}
+
+void AUXStats::decoded()
+{
+    m_framesIn.fetch_add(1, RELAXED);
+}
+
+void AUXStats::replied(AUXCommands cmd, Clock::duration roundTrip)
+{
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(roundTrip).count();
+    int bucket = bucketFor(us > 0 ? us : 0);
+
+    int row = m_rowOf[cmd & 0xff];
+    if (row >= 0)
+    {
+        m_rows[row].buckets[bucket].fetch_add(1, RELAXED);
+        m_rows[row].replies.fetch_add(1, RELAXED);
+    }
+
+    m_rows[ALL].buckets[bucket].fetch_add(1, RELAXED);
+    m_rows[ALL].replies.fetch_add(1, RELAXED);
+}
+
+void AUXStats::timedOut(AUXCommands cmd)
+{
+    int row = m_rowOf[cmd & 0xff];
+    if (row >= 0)
+        m_rows[row].timeouts.fetch_add(1, RELAXED);
+
+    m_rows[ALL].timeouts.fetch_add(1, RELAXED);
+}
+
+void AUXStats::decoderErrors(uint32_t checksumErrors, uint32_t resyncs)
+{
+    m_checksumErrors.store(checksumErrors, RELAXED);
+    m_resyncs.store(resyncs, RELAXED);
+}
+
+void AUXStats::queued(AUXLane lane, Clock::duration delay)
+{
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+    m_lanes[lane].buckets[bucketFor(us > 0 ? us : 0)].fetch_add(1, RELAXED);
+}
+
+void AUXStats::skipped(AUXLane lane)
+{
+    m_lanes[lane].skipped.fetch_add(1, RELAXED);
+}
+
+AUXStats::Totals AUXStats::totals() const
+{
+    Totals totals;
+    totals.bytesOut       = m_bytesOut.load(RELAXED);
+    totals.bytesIn        = m_bytesIn.load(RELAXED);
+    totals.framesOut      = m_framesOut.load(RELAXED);
+    totals.framesIn       = m_framesIn.load(RELAXED);
+    totals.replies        = m_rows[ALL].replies.load(RELAXED);
+    totals.timeouts       = m_rows[ALL].timeouts.load(RELAXED);
+    totals.checksumErrors = m_checksumErrors.load(RELAXED);
+    totals.resyncs        = m_resyncs.load(RELAXED);
+    return totals;
+}
+
+uint64_t AUXStats::replies(AUXCommands cmd) const
+{
+    int row = m_rowOf[cmd & 0xff];
+    return row >= 0 ? m_rows[row].replies.load(RELAXED) : 0;
+}
+
+uint64_t AUXStats::timeouts(AUXCommands cmd) const
+{
+    int row = m_rowOf[cmd & 0xff];
+    return row >= 0 ? m_rows[row].timeouts.load(RELAXED) : 0;
+}
+
+double AUXStats::percentileMs(AUXCommands cmd, double percent) const
+{
+    int row = m_rowOf[cmd & 0xff];
+    return row >= 0 ? percentileMs(m_rows[row].buckets, percent) : 0;
+}
+
+double AUXStats::percentileMs(double percent) const
+{
+    return percentileMs(m_rows[ALL].buckets, percent);
+}
+
+uint64_t AUXStats::skips(AUXLane lane) const
+{
+    return m_lanes[lane].skipped.load(RELAXED);
+}
+
+double AUXStats::queuePercentileMs(AUXLane lane, double percent) const
+{
+    return percentileMs(m_lanes[lane].buckets, percent);
+}
+
+double AUXStats::percentileMs(const std::atomic<uint32_t> *buckets, double percent)
+{
+    // Copy first; the I/O thread may add to the buckets while we walk them.
+    uint32_t counts[BUCKETS];
+    uint64_t total = 0;
+
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        counts[b] = buckets[b].load(RELAXED);
+        total += counts[b];
+    }
+
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(ceil(percent / 100 * total));
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+            return bucketMidpoint(b) / 1000;
+    }
+
+    return bucketMidpoint(BUCKETS - 1) / 1000;
+}
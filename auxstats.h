@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "auxproto.h"
+
+// Priority lanes on the bus, most urgent first. See AUXBus.
+enum AUXLane
+{
+    LANE_URGENT,
+    LANE_MOTION,
+    LANE_POLL,
+    LANE_COUNT
+};
+
+/*
+Counters for the traffic on the AUX bus: bytes and frames each way, decode errors, timeouts, a
+round trip time histogram for each command, and a histogram of how long commands in each lane
+waited for their turn on the wire.
+
+Every counter is a relaxed atomic, so the bus's I/O thread and the threads sending commands record
+without taking a lock, and the driver can read them whenever it likes. Round trips go into log
+linear buckets, four per doubling from 1 us to about 4 s, which puts a percentile within about 12%
+of the real value.
+*/
+class AUXStats
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int BUCKETS = 84;
+
+    struct Totals
+    {
+        uint64_t bytesOut;
+        uint64_t bytesIn;
+        uint64_t framesOut;
+        uint64_t framesIn;
+        uint64_t replies;
+        uint64_t timeouts;
+        uint64_t checksumErrors;
+        uint64_t resyncs;
+    };
+
+    AUXStats();
+
+    void reset();
+
+    void wrote(size_t bytes, uint32_t frames = 1);
+    void read(size_t bytes);
+    void decoded();
+    void replied(AUXCommands cmd, Clock::duration roundTrip);
+    void timedOut(AUXCommands cmd);
+    // The decoder's own running counts.
+    void decoderErrors(uint32_t checksumErrors, uint32_t resyncs);
+    // Time from send() to the command going out, and commands dropped before they went out.
+    void queued(AUXLane lane, Clock::duration delay);
+    void skipped(AUXLane lane);
+
+    Totals totals() const;
+
+    uint64_t replies(AUXCommands cmd) const;
+    uint64_t timeouts(AUXCommands cmd) const;
+
+    // Round trip percentile in ms, for one command or for all of them. 0 without any replies.
+    double percentileMs(AUXCommands cmd, double percent) const;
+    double percentileMs(double percent) const;
+
+    uint64_t skips(AUXLane lane) const;
+    // Queueing delay percentile in ms. 0 if nothing went out in the lane.
+    double queuePercentileMs(AUXLane lane, double percent) const;
+
+    static int bucketFor(uint64_t us);
+    // Middle of a bucket, in us.
+    static double bucketMidpoint(int bucket);
+
+  private:
+    // One row per command in AUX_COMMAND_TABLE, and one more for everything together.
+    static const int ROWS = AUX_COMMAND_COUNT + 1;
+    static const int ALL  = AUX_COMMAND_COUNT;
+
+    struct Row
+    {
+        std::atomic<uint32_t> buckets[BUCKETS];
+        std::atomic<uint32_t> replies;
+        std::atomic<uint32_t> timeouts;
+    };
+
+    struct LaneRow
+    {
+        std::atomic<uint32_t> buckets[BUCKETS];
+        std::atomic<uint32_t> skipped;
+    };
+
+    static double percentileMs(const std::atomic<uint32_t> *buckets, double percent);
+
+    // AUX command byte -> row, or -1 for commands outside the table.
+    int8_t m_rowOf[256];
+    Row m_rows[ROWS];
+    LaneRow m_lanes[LANE_COUNT];
+
+    std::atomic<uint64_t> m_bytesOut;
+    std::atomic<uint64_t> m_bytesIn;
+    std::atomic<uint64_t> m_framesOut;
+    std::atomic<uint64_t> m_framesIn;
+    std::atomic<uint32_t> m_checksumErrors;
+    std::atomic<uint32_t> m_resyncs;
+};
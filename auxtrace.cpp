@@ -0,0 +1,260 @@
+#include "auxtrace.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t AUXTrace::VERSION;
+const size_t AUXTrace::HEADER_SIZE;
+const size_t AUXTrace::MAX_BYTES;
+const uint64_t AUXTrace::DEFAULT_CAPACITY;
+const char AUXTrace::MAGIC[8] = { 'C', 'G', 'X', 'T', 'R', 'A', 'C', 'E' };
+
+static_assert(sizeof(AUXTrace::Header) <= AUXTrace::HEADER_SIZE, "trace header too big");
+static_assert(sizeof(AUXTrace::Record) == 64, "trace records are one cache line");
+
+static int64_t nanoseconds(std::chrono::nanoseconds t)
+{
+    return static_cast<int64_t>(t.count());
+}
+
+AUXTrace::AUXTrace()
+{
+}
+
+AUXTrace::~AUXTrace()
+{
+    close();
+}
+
+bool AUXTrace::open(const std::string &path, uint64_t capacity)
+{
+    close();
+
+    // A power of two, so the ring index is a mask.
+    uint64_t records = 1;
+    while (records < capacity)
+        records <<= 1;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t size = HEADER_SIZE + records * sizeof(Record);
+
+    struct stat st;
+    bool resized = fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size;
+    if (resized && ftruncate(fd, 0) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    if (resized && ftruncate(fd, size) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    Header *header = static_cast<Header *>(map);
+
+    if (resized || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != VERSION || header->recordSize != sizeof(Record) ||
+        header->capacity != records)
+    {
+        // Not ours, or laid out differently; start over. The truncate above already zeroed it if
+        // the size changed.
+        memset(map, 0, size);
+        memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->version    = VERSION;
+        header->recordSize = sizeof(Record);
+        header->capacity   = records;
+        header->next.store(0);
+    }
+
+    header->wallClockNs   = nanoseconds(std::chrono::system_clock::now().time_since_epoch());
+    header->steadyClockNs = nanoseconds(std::chrono::steady_clock::now().time_since_epoch());
+
+    m_fd         = fd;
+    m_mappedSize = size;
+    m_mask       = records - 1;
+    m_records    = reinterpret_cast<Record *>(static_cast<char *>(map) + HEADER_SIZE);
+    m_header     = header;
+    m_path       = path;
+
+    return true;
+}
+
+void AUXTrace::close()
+{
+    stop();
+
+    if (m_header == nullptr)
+        return;
+
+    munmap(m_header, m_mappedSize);
+    ::close(m_fd);
+
+    m_header     = nullptr;
+    m_records    = nullptr;
+    m_fd         = -1;
+    m_mappedSize = 0;
+}
+
+void AUXTrace::start()
+{
+    if (m_header != nullptr)
+        m_recording.store(true, std::memory_order_release);
+}
+
+void AUXTrace::stop()
+{
+    m_recording.store(false);
+
+    // Let the kernel start writing back now rather than whenever it gets round to it.
+    if (m_header != nullptr)
+        msync(m_header, m_mappedSize, MS_ASYNC);
+}
+
+void AUXTrace::append(Direction direction, std::chrono::steady_clock::time_point time,
+                      const unsigned char *data, size_t n)
+{
+    int64_t timeNs = nanoseconds(time.time_since_epoch());
+
+    while (n > 0)
+    {
+        size_t chunk = n < MAX_BYTES ? n : MAX_BYTES;
+
+        uint64_t index = m_header->next.fetch_add(1, std::memory_order_relaxed);
+        Record &record = m_records[index & m_mask];
+
+        // Mark the slot as being rewritten before touching it, then publish it once it's whole.
+        record.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        record.timeNs    = timeNs;
+        record.direction = direction;
+        record.length    = static_cast<uint8_t>(chunk);
+        memcpy(record.bytes, data, chunk);
+
+        record.sequence.store(index + 1, std::memory_order_release);
+
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+AUXTraceReader::AUXTraceReader()
+{
+}
+
+AUXTraceReader::~AUXTraceReader()
+{
+    close();
+}
+
+bool AUXTraceReader::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < AUXTrace::HEADER_SIZE)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *map   = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const AUXTrace::Header *header = static_cast<const AUXTrace::Header *>(map);
+    uint64_t capacity              = header->capacity;
+
+    if (memcmp(header->magic, AUXTrace::MAGIC, sizeof(AUXTrace::MAGIC)) != 0 ||
+        header->version != AUXTrace::VERSION || header->recordSize != sizeof(AUXTrace::Record) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        size != AUXTrace::HEADER_SIZE + capacity * sizeof(AUXTrace::Record))
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    m_header     = header;
+    m_records    = reinterpret_cast<const AUXTrace::Record *>(static_cast<const char *>(map) +
+                                                           AUXTrace::HEADER_SIZE);
+    m_mask       = capacity - 1;
+    m_mappedSize = size;
+
+    m_end   = header->next.load(std::memory_order_acquire);
+    m_first = m_end > capacity ? m_end - capacity : 0;
+    rewind();
+
+    return true;
+}
+
+void AUXTraceReader::close()
+{
+    if (m_header == nullptr)
+        return;
+
+    munmap(const_cast<AUXTrace::Header *>(m_header), m_mappedSize);
+
+    m_header     = nullptr;
+    m_records    = nullptr;
+    m_mappedSize = 0;
+}
+
+void AUXTraceReader::rewind()
+{
+    m_index   = m_first;
+    m_dropped = 0;
+}
+
+bool AUXTraceReader::next(Entry &entry)
+{
+    while (m_index < m_end)
+    {
+        uint64_t index                 = m_index++;
+        const AUXTrace::Record &record = m_records[index & m_mask];
+
+        // Same dance as the writer in reverse: the sequence before and after the copy has to be
+        // this record's, or the writer was in the slot meanwhile.
+        if (record.sequence.load(std::memory_order_acquire) != index + 1)
+        {
+            m_dropped++;
+            continue;
+        }
+
+        entry.timeNs    = record.timeNs;
+        entry.direction = static_cast<AUXTrace::Direction>(record.direction);
+        entry.length    = record.length < AUXTrace::MAX_BYTES ? record.length : AUXTrace::MAX_BYTES;
+        memcpy(entry.bytes, record.bytes, entry.length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.sequence.load(std::memory_order_relaxed) != index + 1)
+        {
+            m_dropped++;
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
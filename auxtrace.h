@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/*
+Records AUX traffic into a memory-mapped ring file, to be pulled and decoded after the fact.
+
+The file is a 4 KiB header followed by CAPACITY fixed-size records. Every frame the driver writes
+is one TO_MOUNT record. Everything read from the port goes in FROM_MOUNT records exactly as the
+read returned it, garbage included, so running the records back through an AUXFrameDecoder
+reproduces what the driver saw. Timestamps are steady_clock nanoseconds. The header maps them to
+wall clock time as of the last open().
+
+Once the ring is full the oldest records are overwritten. Header::next counts every record ever
+written, so the live records are the last min(next, capacity) of them. A record is claimed with
+one atomic add and its sequence number is stored last, so a reader can tell a complete record
+from one being written. Recording while stopped costs one atomic load.
+
+open() and close() must not race record(). Open before starting the threads that record, and
+close after stopping them. start() and stop() can be called at any time.
+*/
+class AUXTrace
+{
+  public:
+    enum Direction : uint8_t
+    {
+        TO_MOUNT   = 0,
+        FROM_MOUNT = 1
+    };
+
+    static const uint32_t VERSION          = 1;
+    static const size_t HEADER_SIZE        = 4096;
+    static const size_t MAX_BYTES          = 40;
+    static const uint64_t DEFAULT_CAPACITY = 1 << 20;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t capacity;
+        std::atomic<uint64_t> next;
+        // The same instant on both clocks, taken at the last open().
+        int64_t wallClockNs;
+        int64_t steadyClockNs;
+    };
+
+    struct Record
+    {
+        // Index of the record plus one, stored last. 0 for a slot never written.
+        std::atomic<uint64_t> sequence;
+        int64_t timeNs;
+        uint8_t direction;
+        uint8_t length;
+        uint8_t reserved[6];
+        uint8_t bytes[MAX_BYTES];
+    };
+
+    static const char MAGIC[8];
+
+    AUXTrace();
+    ~AUXTrace();
+
+    // Maps path, creating it or resizing it as needed. A trace left by an earlier run with the
+    // same capacity is appended to rather than cleared.
+    bool open(const std::string &path, uint64_t capacity = DEFAULT_CAPACITY);
+    void close();
+    bool isOpen() const
+    {
+        return m_header != nullptr;
+    }
+    const std::string &path() const
+    {
+        return m_path;
+    }
+
+    void start();
+    void stop();
+    bool recording() const
+    {
+        return m_recording.load(std::memory_order_relaxed);
+    }
+
+    /*
+    Anything longer than MAX_BYTES is split over several records. The caller passes the time in:
+    reading the clock costs more than the rest of recording, and the bus has the time at hand
+    anyway.
+    */
+    void record(Direction direction, std::chrono::steady_clock::time_point time,
+                const unsigned char *data, size_t n)
+    {
+        if (!m_recording.load(std::memory_order_acquire))
+            return;
+
+        append(direction, time, data, n);
+    }
+
+  private:
+    void append(Direction direction, std::chrono::steady_clock::time_point time,
+                const unsigned char *data, size_t n);
+
+    std::atomic<bool> m_recording{false};
+
+    Header *m_header{nullptr};
+    Record *m_records{nullptr};
+    uint64_t m_mask{0};
+    size_t m_mappedSize{0};
+    int m_fd{-1};
+    std::string m_path;
+};
+
+/*
+Reads a trace file back, oldest record first. The file can still be recording: the reader takes
+the records that were live when it was opened, and drops any overwritten or half written since.
+*/
+class AUXTraceReader
+{
+  public:
+    struct Entry
+    {
+        int64_t timeNs;
+        AUXTrace::Direction direction;
+        uint8_t length;
+        uint8_t bytes[AUXTrace::MAX_BYTES];
+    };
+
+    AUXTraceReader();
+    ~AUXTraceReader();
+
+    // Fails on a file that isn't a trace, or one written with a different layout.
+    bool open(const std::string &path);
+    void close();
+
+    bool next(Entry &entry);
+    // Back to the oldest record live at open().
+    void rewind();
+
+    // Records the writer got to before the reader could copy them.
+    uint64_t dropped() const
+    {
+        return m_dropped;
+    }
+
+    // Wall clock nanoseconds for a record's steady clock time. Only right for records written
+    // since the file was last opened for recording, which is usually all of them.
+    int64_t wallClockNs(int64_t timeNs) const
+    {
+        return m_header->wallClockNs + (timeNs - m_header->steadyClockNs);
+    }
+
+  private:
+    const AUXTrace::Header *m_header{nullptr};
+    const AUXTrace::Record *m_records{nullptr};
+    uint64_t m_mask{0};
+    size_t m_mappedSize{0};
+
+    uint64_t m_first{0};
+    uint64_t m_end{0};
+    uint64_t m_index{0};
+    uint64_t m_dropped{0};
+};
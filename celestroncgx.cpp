@@ -22,10 +22,12 @@
 
 #include <libindi/indicom.h>
 
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
-#include <termios.h>
+#include <string>
 #include <unistd.h>
 
 // We declare an auto pointer to CelestronCGX.
@@ -36,6 +38,21 @@ static std::unique_ptr<CelestronCGX> cgx(new CelestronCGX());
 #define CENTERING_SLEW_RATE 0x03
 #define GUIDE_SLEW_RATE 0x02
 
+#define STATS_INTERVAL_MS 5000
+
+// Where the RA motor controller is told never to go, so the cables can't wind up.
+#define CORDWRAP_HOUR_ANGLE 13.0
+
+static const char *STATISTICS_TAB = "Statistics";
+static const char *POINTING_TAB   = "Pointing";
+
+// The commands AUX_LATENCY breaks round trips down for: everything the driver sends while polling,
+// guiding or slewing.
+static const AUXCommands STATS_COMMANDS[] = {
+    MC_GET_POSITION, MC_SLEW_DONE,        MC_GOTO_FAST,          MC_MOVE_POS,
+    MC_AUX_GUIDE,    MC_AUX_GUIDE_ACTIVE, MC_GET_AUTOGUIDE_RATE, MC_LEVEL_DONE,
+};
+
 void ISPoll(void *p);
 
 void ISGetProperties(const char *dev)
@@ -69,10 +86,16 @@ void ISSnoopDevice(XMLEle *root)
     cgx->ISSnoopDevice(root);
 }
 
-const uint32_t CelestronCGX::STEPS_PER_REVOLUTION = 0x1000000;
-const double CelestronCGX::STEPS_PER_DEGREE       = STEPS_PER_REVOLUTION / 360.0;
+const uint32_t CelestronCGX::STEPS_PER_REVOLUTION;
+const int CelestronCGX::STATS_COMMAND_COUNT;
+const double CelestronCGX::STEPS_PER_DEGREE = STEPS_PER_REVOLUTION / 360.0;
 
-CelestronCGX::CelestronCGX() : m_alignment(STEPS_PER_REVOLUTION)
+CelestronCGX::CelestronCGX()
+    : m_predictor(STEPS_PER_REVOLUTION),
+      m_slewPlanner(STEPS_PER_REVOLUTION, FixedEQAlignment<STEPS_PER_REVOLUTION>::HOME_RA,
+                    FixedEQAlignment<STEPS_PER_REVOLUTION>::HOME_DEC),
+      m_slewModel(STEPS_PER_REVOLUTION),
+      m_pointingModel(STEPS_PER_REVOLUTION, FixedEQAlignment<STEPS_PER_REVOLUTION>::HOME_DEC)
 {
     setVersion(CCGX_VERSION_MAJOR, CCGX_VERSION_MINOR);
 
@@ -81,6 +104,47 @@ CelestronCGX::CelestronCGX() : m_alignment(STEPS_PER_REVOLUTION)
                                TELESCOPE_HAS_TRACK_MODE | TELESCOPE_CAN_CONTROL_TRACK |
                                TELESCOPE_HAS_PIER_SIDE,
                            4);
+
+    m_bus.setTrace(&m_trace);
+
+    m_slewPlanner.setCordwrap(m_alignment.encoderFromHourAngle(CORDWRAP_HOUR_ANGLE));
+
+    m_guideTimers[AXIS_RA] = { this, AXIS_RA, -1, false };
+    m_guideTimers[AXIS_DE] = { this, AXIS_DE, -1, false };
+
+    m_dispatcher.setFallback([this](const AUXCommand &cmd) { handleCommand(cmd); });
+
+    // The motor controllers announce when a goto or an index search finishes, so act on it right
+    // away rather than waiting for the next poll to notice.
+    m_dispatcher.subscribe(MC_SLEW_DONE, ANY, [this](const AUXCommand &cmd) {
+        handleCommand(cmd);
+        checkSlewComplete();
+    });
+    m_dispatcher.subscribe(MC_LEVEL_DONE, ANY, [this](const AUXCommand &cmd) {
+        // The announcement itself carries no payload; it only comes once the axis is at its
+        // index. A polled reply still has to say so.
+        if (!cmd.data.empty())
+        {
+            handleCommand(cmd);
+        }
+        else if (cmd.src == DEC)
+        {
+            m_decAligned = true;
+        }
+        else if (cmd.src == RA)
+        {
+            m_raAligned = true;
+        }
+        checkAlignComplete();
+    });
+
+    // Traffic from a hand controller sharing the bus isn't aimed at us. Replies the motors send
+    // back to it still reach the fallback, so we get its position queries for free.
+    AUXDispatcher::Handler ignore = [this](const AUXCommand &cmd) {
+        LOGF_DEBUG("hand controller: cmd 0x%02x -> 0x%02x", cmd.cmd, cmd.dst);
+    };
+    m_dispatcher.subscribeSource(HC, ignore);
+    m_dispatcher.subscribeSource(HCP, ignore);
 }
 
 const char *CelestronCGX::getDefaultName()
@@ -99,11 +163,99 @@ bool CelestronCGX::initProperties()
                  STEPS_PER_REVOLUTION - 1, 1, m_alignment.GetStepsAtHomePositionDec());
     IUFillNumberVector(&EncoderTicksNP, EncoderTicksN, 2, getDeviceName(), "ENCODER_TICKS",
                        "Encoder Ticks", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+    m_encoderPublisher.attach(&EncoderTicksNP, 1);
 
     IUFillNumber(&LocationDebugN[0], "HA", "HA (hh:mm:ss)", "%010.6m", 0, 24, 0, 0);
     IUFillNumber(&LocationDebugN[1], "LST", "LST (hh:mm:ss)", "%010.6m", 0, 24, 0, 0);
     IUFillNumberVector(&LocationDebugNP, LocationDebugN, 2, getDeviceName(), "MOUNT_POINTING_DEBUG",
                        "Mount Pointing", MAIN_CONTROL_TAB, IP_RO, 60, IPS_IDLE);
+    // One second of time; LST moves every cycle, so anything finer would publish every poll.
+    m_pointingPublisher.attach(&LocationDebugNP, 1.0 / 3600);
+
+    for (int i = 0; i < PollScheduler::MOUNT_STATE_COUNT; i++)
+    {
+        PollScheduler::MountState state = static_cast<PollScheduler::MountState>(i);
+
+        char name[32], label[32];
+        snprintf(name, sizeof(name), "BANDWIDTH_%s", PollScheduler::stateName(state));
+        snprintf(label, sizeof(label), "%s (B/s)", PollScheduler::stateName(state));
+        IUFillNumber(&BusBandwidthN[i], name, label, "%.1f", 0, 100000, 0, 0);
+    }
+    IUFillNumberVector(&BusBandwidthNP, BusBandwidthN, PollScheduler::MOUNT_STATE_COUNT,
+                       getDeviceName(), "POLL_BANDWIDTH", "Poll Bandwidth", OPTIONS_TAB, IP_RO, 0,
+                       IPS_IDLE);
+
+    IUFillNumber(&PublishRateN[0], "MAX_RATE", "Max updates/s", "%.1f", 0.1, 20, 0.5, 4);
+    IUFillNumberVector(&PublishRateNP, PublishRateN, 1, getDeviceName(), "PUBLISH_RATE",
+                       "Status Updates", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+    IUFillNumber(&AuxStatsN[STATS_REQUESTS], "REQUESTS", "Requests/s", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_BYTES_OUT], "BYTES_OUT", "Bytes out/s", "%.0f", 0, 100000, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_BYTES_IN], "BYTES_IN", "Bytes in/s", "%.0f", 0, 100000, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_TIMEOUTS], "TIMEOUTS", "Timeouts", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_CHECKSUM_ERRORS], "CHECKSUM_ERRORS", "Checksum errors", "%.0f",
+                 0, 1e9, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_RESYNCS], "RESYNCS", "Resyncs", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_RTT_P50], "RTT_P50", "Round trip p50 (ms)", "%.2f", 0, 10000, 0,
+                 0);
+    IUFillNumber(&AuxStatsN[STATS_RTT_P95], "RTT_P95", "Round trip p95 (ms)", "%.2f", 0, 10000, 0,
+                 0);
+    IUFillNumber(&AuxStatsN[STATS_RTT_P99], "RTT_P99", "Round trip p99 (ms)", "%.2f", 0, 10000, 0,
+                 0);
+    IUFillNumber(&AuxStatsN[STATS_QUEUE_PEAK], "QUEUE_PEAK", "Unsolicited queue peak", "%.0f", 0,
+                 1000, 0, 0);
+    IUFillNumber(&AuxStatsN[STATS_QUEUE_OVERFLOWS], "QUEUE_OVERFLOWS", "Unsolicited dropped",
+                 "%.0f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&AuxStatsNP, AuxStatsN, STATS_COUNT, getDeviceName(), "AUX_STATS",
+                       "AUX Bus", STATISTICS_TAB, IP_RO, 0, IPS_IDLE);
+
+    static_assert(sizeof(STATS_COMMANDS) / sizeof(STATS_COMMANDS[0]) == STATS_COMMAND_COUNT,
+                  "STATS_COMMANDS and STATS_COMMAND_COUNT disagree");
+    static const int PERCENTILES[3] = { 50, 95, 99 };
+
+    for (int i = 0; i < STATS_COMMAND_COUNT; i++)
+    {
+        const char *command = AUX_COMMAND_TABLE[auxCommandIndex(STATS_COMMANDS[i])].name;
+
+        for (int p = 0; p < 3; p++)
+        {
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, sizeof(name), "%s_P%d", command, PERCENTILES[p]);
+            snprintf(label, sizeof(label), "%s p%d (ms)", command, PERCENTILES[p]);
+            IUFillNumber(&AuxLatencyN[i * 3 + p], name, label, "%.2f", 0, 10000, 0, 0);
+        }
+    }
+    IUFillNumberVector(&AuxLatencyNP, AuxLatencyN, STATS_COMMAND_COUNT * 3, getDeviceName(),
+                       "AUX_LATENCY", "Round Trips", STATISTICS_TAB, IP_RO, 0, IPS_IDLE);
+
+    static const char *LANES[LANE_COUNT] = { "URGENT", "MOTION", "POLL" };
+
+    for (int l = 0; l < LANE_COUNT; l++)
+    {
+        for (int p = 0; p < 2; p++)
+        {
+            int percentile = p == 0 ? 50 : 99;
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, sizeof(name), "%s_P%d", LANES[l], percentile);
+            snprintf(label, sizeof(label), "%s queued p%d (ms)", LANES[l], percentile);
+            IUFillNumber(&AuxLanesN[l * 2 + p], name, label, "%.2f", 0, 10000, 0, 0);
+        }
+    }
+    IUFillNumber(&AuxLanesN[LANE_COUNT * 2], "POLL_SKIPPED", "Polls skipped", "%.0f", 0, 1e9, 0,
+                 0);
+    IUFillNumberVector(&AuxLanesNP, AuxLanesN, LANE_COUNT * 2 + 1, getDeviceName(), "AUX_LANES",
+                       "Queueing", STATISTICS_TAB, IP_RO, 0, IPS_IDLE);
+
+    IUFillSwitch(&TraceS[0], "TRACE_ON", "Record", ISS_OFF);
+    IUFillSwitch(&TraceS[1], "TRACE_OFF", "Off", ISS_ON);
+    IUFillSwitchVector(&TraceSP, TraceS, 2, getDeviceName(), "AUX_TRACE", "Wire Trace",
+                       STATISTICS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    const char *home      = getenv("HOME");
+    std::string traceFile = std::string(home != nullptr ? home : "/tmp") + "/.indi/cgx_trace.bin";
+    IUFillText(&TraceFileT[0], "PATH", "File", traceFile.c_str());
+    IUFillTextVector(&TraceFileTP, TraceFileT, 1, getDeviceName(), "AUX_TRACE_FILE", "Trace File",
+                     STATISTICS_TAB, IP_RW, 0, IPS_IDLE);
 
     // Add Tracking Modes, the order must match the order of the TelescopeTrackMode enum
     AddTrackMode("TRACK_SIDEREAL", "Sidereal", true);
@@ -114,6 +266,66 @@ bool CelestronCGX::initProperties()
     IUFillSwitchVector(&AlignSP, AlignS, 1, getDeviceName(), "ALIGN", "Align", MAIN_CONTROL_TAB,
                        IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
 
+    IUFillNumber(&SlewEtaN[0], "SECONDS", "Arriving in (s)", "%.0f", 0, 3600, 0, 0);
+    IUFillNumberVector(&SlewEtaNP, SlewEtaN, 1, getDeviceName(), "SLEW_ETA", "Slew ETA",
+                       MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+    m_etaPublisher.attach(&SlewEtaNP, 1);
+
+    static const char *AXES[SlewModel::AXES] = { "RA", "DE" };
+
+    for (int a = 0; a < SlewModel::AXES; a++)
+    {
+        char name[MAXINDINAME], label[MAXINDILABEL];
+        INumber *n = &SlewModelN[a * 4];
+
+        snprintf(name, sizeof(name), "%s_ACCELERATION", AXES[a]);
+        snprintf(label, sizeof(label), "%s acceleration (deg/s^2)", AXES[a]);
+        IUFillNumber(&n[0], name, label, "%.2f", 0.01, 50, 0, 0);
+        snprintf(name, sizeof(name), "%s_FAST_RATE", AXES[a]);
+        snprintf(label, sizeof(label), "%s fast rate (deg/s)", AXES[a]);
+        IUFillNumber(&n[1], name, label, "%.2f", 0.01, 20, 0, 0);
+        snprintf(name, sizeof(name), "%s_SLOW_RATE", AXES[a]);
+        snprintf(label, sizeof(label), "%s slow rate (deg/s)", AXES[a]);
+        IUFillNumber(&n[2], name, label, "%.2f", 0.01, 20, 0, 0);
+        snprintf(name, sizeof(name), "%s_APPROACH", AXES[a]);
+        snprintf(label, sizeof(label), "%s approach (s)", AXES[a]);
+        IUFillNumber(&n[3], name, label, "%.1f", 0, 60, 0, 0);
+    }
+    IUFillNumberVector(&SlewModelNP, SlewModelN, SlewModel::AXES * 4, getDeviceName(),
+                       "SLEW_MODEL", "Slew Model", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+    fillSlewModel();
+
+    IUFillSwitch(&PointingModelS[0], "MODEL_ON", "Add to model", ISS_OFF);
+    IUFillSwitch(&PointingModelS[1], "MODEL_OFF", "Set encoders", ISS_ON);
+    IUFillSwitchVector(&PointingModelSP, PointingModelS, 2, getDeviceName(), "POINTING_MODEL",
+                       "Sync", POINTING_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillSwitch(&PointingClearS[0], "CLEAR", "Clear", ISS_OFF);
+    IUFillSwitchVector(&PointingClearSP, PointingClearS, 1, getDeviceName(), "POINTING_CLEAR",
+                       "Sync Points", POINTING_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+    static const char *TERMS[PointingTerms::TERM_COUNT][2] = {
+        { "IH", "HA index (arcmin)" },
+        { "ID", "Dec index (arcmin)" },
+        { "CH", "Cone (arcmin)" },
+        { "NP", "Non-perpendicularity (arcmin)" },
+        { "MA", "Polar axis east (arcmin)" },
+        { "ME", "Polar axis low (arcmin)" },
+        { "TF", "Tube flexure (arcmin)" },
+    };
+
+    for (int t = 0; t < PointingTerms::TERM_COUNT; t++)
+    {
+        IUFillNumber(&PointingTermsN[t], TERMS[t][0], TERMS[t][1], "%.2f", -1e4, 1e4, 0, 0);
+    }
+    IUFillNumber(&PointingTermsN[PointingTerms::TERM_COUNT], "POINTS", "Points", "%.0f", 0,
+                 PointingModel::MAX_POINTS, 0, 0);
+    IUFillNumber(&PointingTermsN[PointingTerms::TERM_COUNT + 1], "RMS", "RMS (arcsec)", "%.1f", 0,
+                 1e6, 0, 0);
+    IUFillNumberVector(&PointingTermsNP, PointingTermsN, PointingTerms::TERM_COUNT + 2,
+                       getDeviceName(), "POINTING_TERMS", "Model", POINTING_TAB, IP_RO, 0,
+                       IPS_IDLE);
+
     IUFillText(&VersionT[0], "VERSION_MAIN", "Main Version", "");
     IUFillText(&VersionT[1], "VERSION_DEC", "Dec Motor Version", "");
     IUFillText(&VersionT[2], "VERSION_RA", "RA Motor Version", "");
@@ -129,6 +341,15 @@ bool CelestronCGX::initProperties()
     IUFillNumber(&GuideRateN[AXIS_DE], "GUIDE_RATE_NS", "N/S Rate", "%.0f", 10, 100, 1, 50);
     IUFillNumberVector(&GuideRateNP, GuideRateN, 2, getDeviceName(), "GUIDE_RATE", "Guiding Rate",
                        GUIDE_TAB, IP_RW, 0, IPS_IDLE);
+    // The motors store the rate in 1/255ths, so a read back can be off by a fraction of a percent.
+    m_guideRatePublisher.attach(&GuideRateNP, 0.5);
+
+    IUFillNumber(&GuideDeliveredN[AXIS_RA], "DELIVERED_WE", "W/E (ms)", "%.0f", -1e6, 1e6, 0, 0);
+    IUFillNumber(&GuideDeliveredN[AXIS_DE], "DELIVERED_NS", "N/S (ms)", "%.0f", -1e6, 1e6, 0, 0);
+    IUFillNumberVector(&GuideDeliveredNP, GuideDeliveredN, 2, getDeviceName(), "GUIDE_DELIVERED",
+                       "Last Pulse", GUIDE_TAB, IP_RO, 0, IPS_IDLE);
+
+    updatePublishRate();
 
     /* Add debug controls so we may debug driver if necessary */
     addDebugControl();
@@ -157,12 +378,36 @@ bool CelestronCGX::updateProperties()
         defineNumber(&GuideWENP);
         defineNumber(&GuideRateNP);
         loadConfig(true, GuideRateNP.name);
+        defineNumber(&GuideDeliveredNP);
 
         defineNumber(&EncoderTicksNP);
         defineNumber(&LocationDebugNP);
 
         defineSwitch(&AlignSP);
+        defineNumber(&SlewEtaNP);
+        defineNumber(&SlewModelNP);
+        loadConfig(true, SlewModelNP.name);
+        defineSwitch(&PointingModelSP);
+        loadConfig(true, PointingModelSP.name);
+        defineSwitch(&PointingClearSP);
+        defineNumber(&PointingTermsNP);
         defineText(&VersionTP);
+        defineNumber(&BusBandwidthNP);
+        defineNumber(&PublishRateNP);
+        loadConfig(true, PublishRateNP.name);
+
+        defineNumber(&AuxStatsNP);
+        defineNumber(&AuxLatencyNP);
+        defineNumber(&AuxLanesNP);
+        defineText(&TraceFileTP);
+        loadConfig(true, TraceFileTP.name);
+        defineSwitch(&TraceSP);
+        loadConfig(true, TraceSP.name);
+
+        m_encoderPublisher.invalidate();
+        m_pointingPublisher.invalidate();
+        m_guideRatePublisher.invalidate();
+        m_etaPublisher.invalidate();
 
         if (InitPark())
         {
@@ -189,10 +434,23 @@ bool CelestronCGX::updateProperties()
         deleteProperty(GuideNSNP.name);
         deleteProperty(GuideWENP.name);
         deleteProperty(GuideRateNP.name);
+        deleteProperty(GuideDeliveredNP.name);
         deleteProperty(EncoderTicksNP.name);
         deleteProperty(LocationDebugNP.name);
         deleteProperty(AlignSP.name);
+        deleteProperty(SlewEtaNP.name);
+        deleteProperty(SlewModelNP.name);
+        deleteProperty(PointingModelSP.name);
+        deleteProperty(PointingClearSP.name);
+        deleteProperty(PointingTermsNP.name);
         deleteProperty(VersionTP.name);
+        deleteProperty(BusBandwidthNP.name);
+        deleteProperty(PublishRateNP.name);
+        deleteProperty(AuxStatsNP.name);
+        deleteProperty(AuxLatencyNP.name);
+        deleteProperty(AuxLanesNP.name);
+        deleteProperty(TraceFileTP.name);
+        deleteProperty(TraceSP.name);
     }
 
     return true;
@@ -209,21 +467,45 @@ bool CelestronCGX::ISNewNumber(const char *dev, const char *name, double values[
         {
             IUUpdateNumber(&GuideRateNP, values, names, n);
             GuideRateNP.s = IPS_OK;
-            IDSetNumber(&GuideRateNP, nullptr);
+            m_guideRatePublisher.publish(NumberPublisher::Clock::now());
 
             uint8_t ra =
                 static_cast<uint8_t>(std::min(GuideRateN[AXIS_RA].value * 256 / 100, 255.0));
             uint8_t dec =
                 static_cast<uint8_t>(std::min(GuideRateN[AXIS_DE].value * 256 / 100, 255.0));
 
-            buffer raData(1);
-            raData[0] = ra;
+            sendCmds({ auxRateCommand<MC_SET_AUTOGUIDE_RATE, RA>(ra),
+                       auxRateCommand<MC_SET_AUTOGUIDE_RATE, DEC>(dec) });
+
+            // Read back what the motors actually took.
+            m_pollScheduler.invalidate(PollScheduler::POLL_AUTOGUIDE_RATE);
+
+            return true;
+        }
+
+        if (strcmp(name, SlewModelNP.name) == 0)
+        {
+            if (IUUpdateNumber(&SlewModelNP, values, names, n) < 0)
+            {
+                SlewModelNP.s = IPS_ALERT;
+                IDSetNumber(&SlewModelNP, nullptr);
+                return false;
+            }
+
+            applySlewModel();
+            SlewModelNP.s = IPS_OK;
+            IDSetNumber(&SlewModelNP, nullptr);
+
+            return true;
+        }
 
-            buffer decData(1);
-            decData[0] = dec;
+        if (strcmp(name, PublishRateNP.name) == 0)
+        {
+            IUUpdateNumber(&PublishRateNP, values, names, n);
+            PublishRateNP.s = IPS_OK;
+            IDSetNumber(&PublishRateNP, nullptr);
 
-            sendCmd(AUXCommand(MC_SET_AUTOGUIDE_RATE, ANY, RA, raData));
-            sendCmd(AUXCommand(MC_SET_AUTOGUIDE_RATE, ANY, DEC, decData));
+            updatePublishRate();
 
             return true;
         }
@@ -247,10 +529,47 @@ bool CelestronCGX::ISNewSwitch(const char *dev, const char *name, ISState *state
             if (IUUpdateSwitch(&AlignSP, states, names, n) < 0)
                 return false;
 
+            // The sync points may have been taken before the encoders knew where home was.
+            clearPointingModel();
             startAlign();
 
             return true;
         }
+
+        if (strcmp(name, PointingModelSP.name) == 0)
+        {
+            if (IUUpdateSwitch(&PointingModelSP, states, names, n) < 0)
+                return false;
+
+            applyPointingModel();
+            PointingModelSP.s = IPS_OK;
+            IDSetSwitch(&PointingModelSP, nullptr);
+
+            return true;
+        }
+
+        if (strcmp(name, PointingClearSP.name) == 0)
+        {
+            clearPointingModel();
+            LOG_INFO("Pointing model cleared");
+
+            IUResetSwitch(&PointingClearSP);
+            PointingClearSP.s = IPS_OK;
+            IDSetSwitch(&PointingClearSP, nullptr);
+
+            return true;
+        }
+
+        if (strcmp(name, TraceSP.name) == 0)
+        {
+            if (IUUpdateSwitch(&TraceSP, states, names, n) < 0)
+                return false;
+
+            TraceSP.s = updateTrace() ? IPS_OK : IPS_ALERT;
+            IDSetSwitch(&TraceSP, nullptr);
+
+            return true;
+        }
     }
 
     //  Nobody has claimed this, so, ignore it
@@ -271,6 +590,19 @@ bool CelestronCGX::ISNewText(const char *dev, const char *name, char *texts[], c
 {
     if (dev != nullptr && strcmp(dev, getDeviceName()) == 0)
     {
+        if (strcmp(name, TraceFileTP.name) == 0)
+        {
+            IUUpdateText(&TraceFileTP, texts, names, n);
+            TraceFileTP.s = IPS_OK;
+            IDSetText(&TraceFileTP, nullptr);
+
+            if (m_trace.isOpen() && m_trace.path() != TraceFileT[0].text)
+            {
+                LOG_INFO("The new trace file is used from the next connect.");
+            }
+
+            return true;
+        }
     }
     // Pass it up the chain
     return INDI::Telescope::ISNewText(dev, name, texts, names, n);
@@ -287,6 +619,15 @@ bool CelestronCGX::Connect()
 bool CelestronCGX::Disconnect()
 {
     LOG_INFO("CGX is offline.");
+
+    removeUnsolicitedCallback();
+    cancelGuiding();
+    m_bus.stop();
+    dropPollCycle();
+
+    // Nothing is recording now the bus is stopped, so the file can be let go of.
+    m_trace.close();
+
     return INDI::Telescope::Disconnect();
 }
 
@@ -294,94 +635,128 @@ bool CelestronCGX::Handshake()
 {
     LOG_INFO("Starting Handshake");
 
-    AUXCommand raVer(GET_VER, ANY, RA);
-    if (!sendCmd(raVer))
+    // A failed attempt, e.g. while the port is being searched for, never got to Disconnect().
+    // Starting the bus closes the fd the old callback watches.
+    removeUnsolicitedCallback();
+
+    if (!m_bus.start(PortFD))
     {
-        LOG_ERROR("error sending raVer");
+        LOG_ERROR("error starting serial I/O");
         return false;
     }
 
-    AUXCommand decVer(GET_VER, ANY, DEC);
-    if (!sendCmd(decVer))
+    m_unsolicitedCallbackID = IEAddCallback(m_bus.notifyFD(), unsolicitedCallback, this);
+
+    if (TraceS[0].s == ISS_ON)
+    {
+        updateTrace();
+    }
+
+    // The bus starts counting from zero.
+    m_statsTotals    = AUXStats::Totals();
+    m_statsOverflows = 0;
+    m_statsPublished = PollScheduler::Clock::now();
+    m_pollScheduler.invalidate(PollScheduler::POLL_AUTOGUIDE_RATE);
+    m_predictor.reset();
+    dropPollCycle();
+    cancelGuiding();
+    m_pulsers[AXIS_RA].reset();
+    m_pulsers[AXIS_DE].reset();
+
+    if (!sendCmd(auxQuery<GET_VER, RA>()))
+    {
+        LOG_ERROR("error sending raVer");
+        return abandonHandshake();
+    }
+
+    if (!sendCmd(auxQuery<GET_VER, DEC>()))
     {
         LOG_ERROR("error sending decVer");
-        return false;
+        return abandonHandshake();
     }
 
     return INDI::Telescope::Handshake();
 }
 
-bool CelestronCGX::sendCmd(AUXCommand cmd)
+bool CelestronCGX::abandonHandshake()
 {
-    buffer buf;
-    int nbytes_written = 0;
+    // The connection closes the port next, without a Disconnect(); nothing may be left reading
+    // it or recording from it.
+    removeUnsolicitedCallback();
+    m_bus.stop();
+    m_trace.close();
 
-    cmd.fillBuf(buf);
+    return false;
+}
+
+bool CelestronCGX::sendCmd(const AUXCommand &cmd, AUXLane lane)
+{
+    return awaitReply(m_bus.send(cmd, lane));
+}
 
-    bool success = tty_write(PortFD, (char *)buf.data(), buf.size(), &nbytes_written) == TTY_OK;
-    if (!success)
+bool CelestronCGX::sendCmds(const AUXBatch &cmds, AUXLane lane)
+{
+    AUXBus::Ticket tickets[AUXBatch::CAPACITY];
+
+    m_bus.send(cmds, tickets, lane);
+
+    bool success = true;
+    for (size_t i = 0; i < cmds.size(); i++)
     {
-        return false;
+        success = awaitReply(tickets[i]) && success;
     }
 
-    success = tcflush(PortFD, TCIOFLUSH) == TTY_OK;
-    if (!success)
+    return success;
+}
+
+bool CelestronCGX::awaitReply(AUXBus::Ticket ticket)
+{
+    AUXCommand reply;
+
+    if (!m_bus.wait(ticket, reply))
     {
         return false;
     }
 
-    return readCmd();
+    return handleCommand(reply);
 }
 
-bool CelestronCGX::readCmd(int timeout)
+void CelestronCGX::unsolicitedCallback(int fd, void *p)
 {
-    AUXCommand cmd;
-
-    int n;
-    unsigned char buf[32];
-    bool success = true;
+    INDI_UNUSED(fd);
 
-    do
-    {
-        int result = tty_read(PortFD, (char *)buf, 1, timeout, &n);
-        if (result != TTY_OK)
-        {
-            return false;
-        }
-    } while (buf[0] != 0x3b);
+    CelestronCGX *driver = static_cast<CelestronCGX *>(p);
+    driver->processUnsolicited();
+    driver->collectPolls();
+}
 
-    if (timeout == 0)
+void CelestronCGX::removeUnsolicitedCallback()
+{
+    if (m_unsolicitedCallbackID != -1)
     {
-        // we found something, so make sure to set the timeout back to something reasonable
-        timeout = 1;
+        IERmCallback(m_unsolicitedCallbackID);
+        m_unsolicitedCallbackID = -1;
     }
+}
 
-    // Found the start of a packet, now read the length.
-    success = tty_read(PortFD, (char *)(buf + 1), 1, timeout, &n) == TTY_OK;
-    if (!success)
-    {
-        LOG_ERROR("error finding packet length");
-        return false;
-    }
+void CelestronCGX::processUnsolicited()
+{
+    AUXCommand cmd;
 
-    // Read the rest of the packet and verify the length. Add one for the checksum byte.
-    success =
-        tty_read(PortFD, (char *)(buf + 2), buf[1] + 1, timeout, &n) == TTY_OK && n == buf[1] + 1;
-    if (!success)
-    {
-        LOG_ERROR("error reading packet");
-        return false;
-    }
+    m_bus.clearNotify();
 
-    // make a clean buffer that just contains the packet
-    buffer b(buf, buf + (n + 2));
+    // A slew started from a SLEW_DONE or LEVEL_DONE sees the same sidereal time throughout.
+    m_alignment.holdTime();
 
-    cmd.parseBuf(b);
+    while (m_bus.nextUnsolicited(cmd))
+    {
+        m_dispatcher.dispatch(cmd);
+    }
 
-    return handleCommand(cmd);
+    m_alignment.releaseTime();
 }
 
-bool CelestronCGX::handleCommand(AUXCommand cmd)
+bool CelestronCGX::handleCommand(const AUXCommand &cmd)
 {
     switch (cmd.cmd)
     {
@@ -407,26 +782,40 @@ bool CelestronCGX::handleCommand(AUXCommand cmd)
 
         return true;
     case MC_GET_POSITION:
+    {
+        uint32_t steps;
+        if (!auxDecodePosition<MC_GET_POSITION>(cmd, steps))
+        {
+            return false;
+        }
+
+        int axis                                = cmd.src == DEC ? AXIS_DE : AXIS_RA;
+        EncoderPredictor::Clock::time_point now = EncoderPredictor::Clock::now();
+
+        m_slewModel.sampled(axis, steps, now);
+        if (!m_predictor.sample(axis, steps, now))
+        {
+            LOGF_DEBUG("%s encoder off its predicted position, polling until it settles",
+                       axis == AXIS_DE ? "DEC" : "RA");
+        }
+
+        // Published from ReadScopeStatus, once per cycle.
         if (cmd.src == DEC)
         {
-            uint32_t steps               = cmd.getPosition();
-            EncoderTicksN[AXIS_DE].value = steps;
+            m_encoderPublisher.set(AXIS_DE, steps);
             m_alignment.UpdateStepsDec(steps);
         }
         else if (cmd.src == RA)
         {
-            uint32_t steps               = cmd.getPosition();
-            EncoderTicksN[AXIS_RA].value = steps;
+            m_encoderPublisher.set(AXIS_RA, steps);
             m_alignment.UpdateStepsRA(steps);
 
-            LocationDebugN[0].value = m_alignment.hourAngleFromEncoder();
-            LocationDebugN[1].value = m_alignment.localSiderealTime();
-
-            IDSetNumber(&LocationDebugNP, nullptr);
+            m_pointingPublisher.set(0, m_alignment.hourAngleFromEncoder());
+            m_pointingPublisher.set(1, m_alignment.localSiderealTime());
         }
-        EncoderTicksNP.s = IPS_OK;
-        IDSetNumber(&EncoderTicksNP, nullptr);
+        m_encoderPublisher.setState(IPS_OK);
         return true;
+    }
     case MC_LEVEL_START:
         return true;
     case MC_LEVEL_DONE:
@@ -453,47 +842,86 @@ bool CelestronCGX::handleCommand(AUXCommand cmd)
     case MC_SET_POS_GUIDERATE:
         return true;
     case MC_SLEW_DONE:
+    {
+        bool slewing = !cmd.data.empty() && cmd.data[0] == 0x00;
+        int axis;
+
         if (cmd.src == DEC)
         {
-            m_decSlewing = cmd.data[0] == 0x00;
+            m_decSlewing = slewing;
+            m_decLegDone = m_decLegDone || !slewing;
+            axis         = AXIS_DE;
         }
         else if (cmd.src == RA)
         {
-            m_raSlewing = cmd.data[0] == 0x00;
+            m_raSlewing = slewing;
+            m_raLegDone = m_raLegDone || !slewing;
+            axis        = AXIS_RA;
+        }
+        else
+        {
+            return true;
+        }
+
+        // Every goto that runs to the end teaches the model a little more.
+        if (!slewing && m_slewModel.finished(axis, SlewModel::Clock::now()))
+        {
+            fillSlewModel();
+            IDSetNumber(&SlewModelNP, nullptr);
         }
         return true;
+    }
     case MC_GET_AUTOGUIDE_RATE:
+    {
+        unsigned char rate;
+        if (!auxDecodeByte<MC_GET_AUTOGUIDE_RATE>(cmd, rate))
+        {
+            return false;
+        }
+
         if (cmd.src == DEC)
         {
-            GuideRateN[AXIS_DE].value = cmd.data[0] * 100.0 / 255;
+            m_guideRatePublisher.set(AXIS_DE, rate * 100.0 / 255);
         }
         else if (cmd.src == RA)
         {
-            GuideRateN[AXIS_RA].value = cmd.data[0] * 100.0 / 255;
+            m_guideRatePublisher.set(AXIS_RA, rate * 100.0 / 255);
         }
-        IDSetNumber(&GuideRateNP, nullptr);
 
         return true;
+    }
     case MC_SET_AUTOGUIDE_RATE:
         return true;
     case MC_AUX_GUIDE:
         return true;
     case MC_AUX_GUIDE_ACTIVE:
+    {
+        unsigned char active;
+        if (!auxDecodeByte<MC_AUX_GUIDE_ACTIVE>(cmd, active))
+        {
+            return false;
+        }
+
+        // The motor is idle between the segments of a long pulse, and a reply to a poll sent
+        // before the last segment can still say so.
+        GuidePulser::Clock::time_point now = GuidePulser::Clock::now();
+
         if (cmd.src == DEC)
         {
-            if (cmd.data[0] == 0)
+            if (active == 0 && !m_pulsers[AXIS_DE].busy(now))
             {
                 GuideComplete(AXIS_DE);
             }
         }
         else if (cmd.src == RA)
         {
-            if (cmd.data[0] == 0)
+            if (active == 0 && !m_pulsers[AXIS_RA].busy(now))
             {
                 GuideComplete(AXIS_RA);
             }
         }
         return true;
+    }
     case MC_SET_CORDWRAP_POS:
         return true;
     case MC_ENABLE_CORDWRAP:
@@ -517,114 +945,101 @@ bool CelestronCGX::startAlign()
     m_raAligned  = false;
     m_decAligned = false;
 
-    if (!sendCmd(AUXCommand(MC_LEVEL_START, ANY, RA)))
-    {
-        LOG_ERROR("error starting align on az");
-        return false;
-    }
+    m_predictor.setRateUnknown(AXIS_RA);
+    m_predictor.setRateUnknown(AXIS_DE);
 
-    if (!sendCmd(AUXCommand(MC_LEVEL_START, ANY, DEC)))
+    if (!sendCmds({ auxQuery<MC_LEVEL_START, RA>(), auxQuery<MC_LEVEL_START, DEC>() }))
     {
-        LOG_ERROR("error starting align on alt");
+        LOG_ERROR("error starting align");
         return false;
     }
 
     return true;
 }
 
-bool CelestronCGX::getDec()
-{
-    return sendCmd(AUXCommand(MC_GET_POSITION, ANY, DEC));
-}
-
-bool CelestronCGX::getRA()
+bool CelestronCGX::getPositions()
 {
-    AUXCommand getPos(MC_GET_POSITION, ANY, RA);
-    return sendCmd(getPos);
+    return sendCmds({ auxQuery<MC_GET_POSITION, DEC>(), auxQuery<MC_GET_POSITION, RA>() });
 }
 
-bool CelestronCGX::ReadScopeStatus()
+void CelestronCGX::checkAlignComplete()
 {
-    // Read any commands from the mount that we didn't initiate.
-    while (readCmd(0))
-        ;
-
-    getDec();
-    getRA();
-
-    sendCmd(AUXCommand(MC_GET_AUTOGUIDE_RATE, ANY, RA));
-    sendCmd(AUXCommand(MC_GET_AUTOGUIDE_RATE, ANY, DEC));
-
-    if (GuideNSNP.s == IPS_BUSY)
-    {
-        sendCmd(AUXCommand(MC_AUX_GUIDE_ACTIVE, ANY, DEC));
-    }
-
-    if (GuideWENP.s == IPS_BUSY)
+    if (AlignSP.s != IPS_BUSY || !m_raAligned || !m_decAligned)
     {
-        sendCmd(AUXCommand(MC_AUX_GUIDE_ACTIVE, ANY, RA));
+        return;
     }
 
-    if (AlignSP.s == IPS_BUSY)
-    {
-        sendCmd(AUXCommand(MC_LEVEL_DONE, ANY, RA));
-        sendCmd(AUXCommand(MC_LEVEL_DONE, ANY, DEC));
+    // We are at switch position, so set the motor position to be
+    // in the middle of the range.
 
-        if (m_raAligned && m_decAligned)
-        {
-            // We are at switch position, so set the motor position to be
-            // in the middle of the range.
+    // wait for the motors to actually stop
+    usleep(1000 * 500); // 500ms
 
-            // wait for the motors to actually stop
-            usleep(1000 * 500); // 500ms
+    sendCmds({ auxPositionCommand<MC_SET_POSITION, RA>(m_alignment.GetStepsAtHomePositionRA()),
+               auxPositionCommand<MC_SET_POSITION, DEC>(m_alignment.GetStepsAtHomePositionDec()) });
+    m_predictor.reset();
 
-            AUXCommand raCmd(MC_SET_POSITION, ANY, RA);
-            raCmd.setPosition(m_alignment.GetStepsAtHomePositionRA());
-            sendCmd(raCmd);
+    sendCmd(auxPositionCommand<MC_SET_CORDWRAP_POS, RA>(
+        m_alignment.encoderFromHourAngle(CORDWRAP_HOUR_ANGLE)));
 
-            AUXCommand decCmd(MC_SET_POSITION, ANY, DEC);
-            decCmd.setPosition(m_alignment.GetStepsAtHomePositionDec());
-            sendCmd(decCmd);
+    sendCmd(auxQuery<MC_ENABLE_CORDWRAP, RA>());
 
-            AUXCommand wrapCmd(MC_SET_CORDWRAP_POS, ANY, RA);
-            wrapCmd.setPosition(m_alignment.encoderFromHourAngle(13.0));
-            sendCmd(wrapCmd);
+    TelescopeStatus state = TrackState;
 
-            sendCmd(AUXCommand(MC_ENABLE_CORDWRAP, ANY, RA));
+    SetTrackEnabled(false);
 
-            TelescopeStatus state = TrackState;
+    getPositions();
 
-            SetTrackEnabled(false);
+    AlignSP.s   = IPS_OK;
+    AlignS[0].s = ISS_OFF;
+    IDSetSwitch(&AlignSP, nullptr);
 
-            getDec();
-            getRA();
+    if (m_raTarget != nullptr && m_decTarget != nullptr)
+    {
+        // We are actually doing a slew to this target, so keep going.
+        double ra  = *m_raTarget;
+        double dec = *m_decTarget;
 
-            AlignSP.s   = IPS_OK;
-            AlignS[0].s = ISS_OFF;
-            IDSetSwitch(&AlignSP, nullptr);
+        clearSlewTarget();
+        StartSlew(ra, dec, state, true);
+    }
+    else
+    {
+        LOG_INFO("CGX is now aligned");
+    }
+}
 
-            if (m_raTarget != nullptr && m_decTarget != nullptr)
-            {
-                // We are actually doing a slew to this target, so keep going.
-                StartSlew(*m_raTarget, *m_decTarget, state, true);
+void CelestronCGX::checkSlewComplete()
+{
+    // A slew waiting on the index search hasn't been started yet.
+    if (AlignSP.s == IPS_BUSY)
+    {
+        return;
+    }
 
-                delete m_raTarget;
-                delete m_decTarget;
-                m_raTarget  = nullptr;
-                m_decTarget = nullptr;
-            }
-            else
-            {
-                LOG_INFO("CGX is now aligned");
-            }
+    // A planned slew carries on once both motors have finished the leg. The last leg is aimed
+    // afresh, as the target has moved with the sky meanwhile.
+    if ((TrackState == SCOPE_SLEWING || TrackState == SCOPE_PARKING) && !m_manualSlew &&
+        m_raLegDone && m_decLegDone && m_raTarget != nullptr && m_decTarget != nullptr)
+    {
+        if (m_nextWaypoint + 1 < m_slewPlanner.size())
+        {
+            driveToWaypoint();
+            return;
         }
+
+        double ra                  = *m_raTarget;
+        double dec                 = *m_decTarget;
+        TelescopeStatus remembered = RememberTrackState;
+
+        clearSlewTarget();
+        StartSlew(ra, dec, TrackState, true);
+        RememberTrackState = remembered;
+        return;
     }
 
     if (TrackState == SCOPE_SLEWING)
     {
-        sendCmd(AUXCommand(MC_SLEW_DONE, ANY, RA));
-        sendCmd(AUXCommand(MC_SLEW_DONE, ANY, DEC));
-
         if (m_manualSlew)
         {
             if (MovementNSSP.s == IPS_IDLE && MovementWESP.s == IPS_IDLE)
@@ -640,69 +1055,488 @@ bool CelestronCGX::ReadScopeStatus()
     }
     else if (TrackState == SCOPE_PARKING)
     {
-        sendCmd(AUXCommand(MC_SLEW_DONE, ANY, RA));
-        sendCmd(AUXCommand(MC_SLEW_DONE, ANY, DEC));
-
         if (!m_decSlewing && !m_raSlewing)
         {
             SetTrackEnabled(false);
             SetParked(true);
         }
     }
+}
 
-    EQAlignment::TelescopePierSide pierSide;
-    double ra, dec;
+bool CelestronCGX::ReadScopeStatus()
+{
+    // Pick up anything the mount sent on its own, and poll replies, that the event loop hasn't
+    // gotten to yet.
+    processUnsolicited();
+    collectPolls();
 
-    m_alignment.RADecFromEncoderValues(ra, dec, pierSide);
+    // The mount is behind our timer. Let the last cycle finish rather than queue more polls.
+    if (m_pollCycle)
+    {
+        return true;
+    }
 
-    setPierSide(static_cast<TelescopePierSide>(pierSide));
-    NewRaDec(ra, dec);
+    // Every conversion while queueing sees the same sidereal time.
+    m_alignment.holdTime();
 
-    return true;
-}
+    PollScheduler::Clock::time_point now = PollScheduler::Clock::now();
 
-bool CelestronCGX::Goto(double r, double d)
-{
-    StartSlew(r, d, SCOPE_SLEWING);
-    return true;
-}
+    PollScheduler::MountState state = mountState();
+    if (state != m_pollScheduler.state())
+    {
+        // Report what the state we are leaving cost us, now that its numbers are final.
+        BusBandwidthN[m_pollScheduler.state()].value =
+            m_pollScheduler.bytesPerSecond(m_pollScheduler.state(), now);
+        BusBandwidthNP.s = IPS_OK;
+        IDSetNumber(&BusBandwidthNP, nullptr);
+
+        LOGF_DEBUG("Poll state %s -> %s", PollScheduler::stateName(m_pollScheduler.state()),
+                   PollScheduler::stateName(state));
+        m_pollScheduler.setState(state, now);
+    }
+    m_pollScheduler.setTolerance(POLLMS / 2);
 
-bool CelestronCGX::Abort()
-{
-    if (MovementNSSP.s == IPS_BUSY)
+    // Between position polls the encoders are extrapolated; poll for real whenever that can't be
+    // trusted.
+    if (!m_predictor.confident())
     {
-        MovementNSSP.s = IPS_IDLE;
-        IUResetSwitch(&MovementNSSP);
-        IDSetSwitch(&MovementNSSP, nullptr);
+        m_pollScheduler.invalidate(PollScheduler::POLL_POSITION);
     }
 
-    if (MovementWESP.s == IPS_BUSY)
+    m_pollCount      = 0;
+    m_positionPolled = m_pollScheduler.due(PollScheduler::POLL_POSITION, now);
+    m_slewPolled     = m_pollScheduler.due(PollScheduler::POLL_SLEW_DONE, now);
+
+    if (m_positionPolled)
     {
-        MovementWESP.s = IPS_IDLE;
-        IUResetSwitch(&MovementWESP);
-        IDSetSwitch(&MovementWESP, nullptr);
+        postPoll(auxQuery<MC_GET_POSITION, DEC>(), PollScheduler::POLL_POSITION);
+        postPoll(auxQuery<MC_GET_POSITION, RA>(), PollScheduler::POLL_POSITION);
+        m_pollScheduler.polled(PollScheduler::POLL_POSITION, 2, now);
     }
 
-    if (EqNP.s == IPS_BUSY)
+    if (m_pollScheduler.due(PollScheduler::POLL_AUTOGUIDE_RATE, now))
     {
-        EqNP.s = IPS_IDLE;
-        IDSetNumber(&EqNP, nullptr);
+        postPoll(auxQuery<MC_GET_AUTOGUIDE_RATE, RA>(), PollScheduler::POLL_AUTOGUIDE_RATE);
+        postPoll(auxQuery<MC_GET_AUTOGUIDE_RATE, DEC>(), PollScheduler::POLL_AUTOGUIDE_RATE);
+        m_pollScheduler.polled(PollScheduler::POLL_AUTOGUIDE_RATE, 2, now);
     }
 
-    TrackState = SCOPE_IDLE;
+    if (m_pollScheduler.due(PollScheduler::POLL_GUIDE_ACTIVE, now))
+    {
+        int axes = 0;
+        if (GuideNSNP.s == IPS_BUSY)
+        {
+            postPoll(auxQuery<MC_AUX_GUIDE_ACTIVE, DEC>(), PollScheduler::POLL_GUIDE_ACTIVE);
+            axes++;
+        }
+        if (GuideWENP.s == IPS_BUSY)
+        {
+            postPoll(auxQuery<MC_AUX_GUIDE_ACTIVE, RA>(), PollScheduler::POLL_GUIDE_ACTIVE);
+            axes++;
+        }
+        m_pollScheduler.polled(PollScheduler::POLL_GUIDE_ACTIVE, axes, now);
+    }
 
-    buffer dat(1);
-    dat[0] = 0x00;
+    if (m_pollScheduler.due(PollScheduler::POLL_LEVEL_DONE, now))
+    {
+        postPoll(auxQuery<MC_LEVEL_DONE, RA>(), PollScheduler::POLL_LEVEL_DONE);
+        postPoll(auxQuery<MC_LEVEL_DONE, DEC>(), PollScheduler::POLL_LEVEL_DONE);
+        m_pollScheduler.polled(PollScheduler::POLL_LEVEL_DONE, 2, now);
+    }
+
+    if (m_slewPolled)
+    {
+        postPoll(auxQuery<MC_SLEW_DONE, RA>(), PollScheduler::POLL_SLEW_DONE);
+        postPoll(auxQuery<MC_SLEW_DONE, DEC>(), PollScheduler::POLL_SLEW_DONE);
+        m_pollScheduler.polled(PollScheduler::POLL_SLEW_DONE, 2, now);
+    }
+
+    m_pollsOutstanding = m_pollCount;
+    m_pollCycle        = true;
+
+    m_alignment.releaseTime();
 
-    sendCmd(AUXCommand(MC_MOVE_POS, ANY, DEC, dat));
-    sendCmd(AUXCommand(MC_MOVE_POS, ANY, RA, dat));
+    // Nothing due, or nothing could be queued; the cycle is already over.
+    if (m_pollsOutstanding == 0)
+    {
+        finishPollCycle();
+    }
 
     return true;
 }
 
-bool CelestronCGX::Park()
+void CelestronCGX::postPoll(const AUXCommand &cmd, PollScheduler::Query query)
 {
-    SetTrackEnabled(false);
+    AUXBus::Ticket ticket = m_bus.post(cmd, LANE_POLL);
+
+    // The bus is full; ask again next cycle.
+    if (ticket == AUXBus::NO_TICKET)
+    {
+        m_pollScheduler.invalidate(query);
+        return;
+    }
+
+    m_polls[m_pollCount].ticket       = ticket;
+    m_polls[m_pollCount].query        = query;
+    m_polls[m_pollCount].gotoSequence = m_gotoSequence;
+    m_pollCount++;
+}
+
+void CelestronCGX::collectPolls()
+{
+    if (!m_pollCycle)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < m_pollCount; i++)
+    {
+        PendingPoll &poll = m_polls[i];
+        if (poll.ticket == AUXBus::NO_TICKET)
+        {
+            continue;
+        }
+
+        AUXCommand reply;
+        AUXBus::Result result = m_bus.collect(poll.ticket, reply);
+        if (result == AUXBus::PENDING)
+        {
+            continue;
+        }
+
+        bool stale = poll.query == PollScheduler::POLL_SLEW_DONE &&
+                     poll.gotoSequence != m_gotoSequence;
+
+        if (result == AUXBus::REPLIED && !stale)
+        {
+            handleCommand(reply);
+        }
+        else
+        {
+            // Timed out, skipped for an urgent command, or asked before the latest goto. Either
+            // way the answer is still owed.
+            m_pollScheduler.invalidate(poll.query);
+            if (poll.query == PollScheduler::POLL_POSITION)
+            {
+                m_positionPolled = false;
+            }
+            else if (poll.query == PollScheduler::POLL_SLEW_DONE)
+            {
+                m_slewPolled = false;
+            }
+        }
+
+        poll.ticket = AUXBus::NO_TICKET;
+        m_pollsOutstanding--;
+    }
+
+    if (m_pollsOutstanding == 0)
+    {
+        finishPollCycle();
+    }
+}
+
+void CelestronCGX::finishPollCycle()
+{
+    m_pollCycle = false;
+
+    // A motor announces the end of a goto before it answers any poll about it. Act on the
+    // announcement first, or it would arrive after the next leg was sent and count towards it.
+    processUnsolicited();
+
+    PollScheduler::Clock::time_point now = PollScheduler::Clock::now();
+
+    // Every conversion from here on sees the same sidereal time.
+    m_alignment.holdTime();
+
+    collectPointingModel();
+
+    if (AlignSP.s == IPS_BUSY)
+    {
+        checkAlignComplete();
+    }
+
+    if (m_slewPolled && (TrackState == SCOPE_SLEWING || TrackState == SCOPE_PARKING))
+    {
+        checkSlewComplete();
+    }
+
+    // Until both axes have been read since the last reset there is nothing to extrapolate from,
+    // and whatever was published last stands.
+    bool positionKnown = m_predictor.sampled(AXIS_RA) && m_predictor.sampled(AXIS_DE);
+
+    if (!m_positionPolled && positionKnown)
+    {
+        uint32_t raSteps  = m_predictor.predict(AXIS_RA, now);
+        uint32_t decSteps = m_predictor.predict(AXIS_DE, now);
+
+        m_alignment.UpdateSteps(raSteps, decSteps);
+        m_encoderPublisher.set(AXIS_RA, raSteps);
+        m_encoderPublisher.set(AXIS_DE, decSteps);
+        m_pointingPublisher.set(0, m_alignment.hourAngleFromEncoder());
+        m_pointingPublisher.set(1, m_alignment.localSiderealTime());
+    }
+
+    if (positionKnown)
+    {
+        EQAlignment::TelescopePierSide pierSide;
+        double ra, dec;
+
+        m_alignment.RADecFromEncoderValues(ra, dec, pierSide);
+
+        setPierSide(static_cast<TelescopePierSide>(pierSide));
+        NewRaDec(ra, dec);
+    }
+
+    m_encoderPublisher.flush(now);
+    m_pointingPublisher.flush(now);
+    m_guideRatePublisher.flush(now);
+
+    // Counts down while a goto runs. A manual slew, or the end of the goto, stops it.
+    if (SlewEtaNP.s == IPS_BUSY)
+    {
+        bool going  = (TrackState == SCOPE_SLEWING || TrackState == SCOPE_PARKING) && !m_manualSlew;
+        double left = std::chrono::duration<double>(m_slewArrival - now).count();
+
+        m_etaPublisher.set(0, going && left > 0 ? left : 0);
+        if (!going)
+        {
+            m_etaPublisher.setState(IPS_OK);
+        }
+    }
+    m_etaPublisher.flush(now);
+
+    if (now - m_statsPublished >= std::chrono::milliseconds(STATS_INTERVAL_MS))
+    {
+        publishStats(now);
+    }
+
+    m_alignment.releaseTime();
+}
+
+void CelestronCGX::dropPollCycle()
+{
+    m_pollCycle        = false;
+    m_pollCount        = 0;
+    m_pollsOutstanding = 0;
+}
+
+void CelestronCGX::collectPointingModel()
+{
+    PointingTerms terms;
+    double rms;
+
+    if (!m_pointingModel.collect(terms, rms))
+    {
+        return;
+    }
+
+    m_pointingTerms = terms;
+    applyPointingModel();
+
+    for (int t = 0; t < PointingTerms::TERM_COUNT; t++)
+    {
+        PointingTermsN[t].value = terms[t] * 60;
+    }
+    PointingTermsN[PointingTerms::TERM_COUNT].value     = m_pointingModel.size();
+    PointingTermsN[PointingTerms::TERM_COUNT + 1].value = rms * 3600;
+    PointingTermsNP.s                                   = IPS_OK;
+    IDSetNumber(&PointingTermsNP, nullptr);
+
+    if (terms.active())
+    {
+        LOGF_INFO("Pointing model fitted to %d points, rms %.1f arcsec",
+                  static_cast<int>(m_pointingModel.size()), rms * 3600);
+    }
+}
+
+void CelestronCGX::applyPointingModel()
+{
+    m_alignment.setPointingTerms(PointingModelS[0].s == ISS_ON ? m_pointingTerms
+                                                               : PointingTerms());
+}
+
+void CelestronCGX::clearPointingModel()
+{
+    m_pointingModel.clear();
+    m_pointingTerms = PointingTerms();
+    applyPointingModel();
+
+    for (int t = 0; t < PointingTerms::TERM_COUNT + 2; t++)
+    {
+        PointingTermsN[t].value = 0;
+    }
+    PointingTermsNP.s = IPS_IDLE;
+    IDSetNumber(&PointingTermsNP, nullptr);
+}
+
+void CelestronCGX::updatePublishRate()
+{
+    int ms = static_cast<int>(1000 / PublishRateN[0].value);
+
+    m_encoderPublisher.setMinInterval(ms);
+    m_pointingPublisher.setMinInterval(ms);
+    m_guideRatePublisher.setMinInterval(ms);
+    m_etaPublisher.setMinInterval(ms);
+}
+
+void CelestronCGX::publishStats(PollScheduler::Clock::time_point now)
+{
+    const AUXStats &stats  = m_bus.stats();
+    AUXStats::Totals total = stats.totals();
+
+    double seconds = std::chrono::duration<double>(now - m_statsPublished).count();
+
+    // Rates over the last interval; error counts and round trips since we connected.
+    AuxStatsN[STATS_REQUESTS].value        = (total.framesOut - m_statsTotals.framesOut) / seconds;
+    AuxStatsN[STATS_BYTES_OUT].value       = (total.bytesOut - m_statsTotals.bytesOut) / seconds;
+    AuxStatsN[STATS_BYTES_IN].value        = (total.bytesIn - m_statsTotals.bytesIn) / seconds;
+    AuxStatsN[STATS_TIMEOUTS].value        = total.timeouts;
+    AuxStatsN[STATS_CHECKSUM_ERRORS].value = total.checksumErrors;
+    AuxStatsN[STATS_RESYNCS].value         = total.resyncs;
+    AuxStatsN[STATS_RTT_P50].value         = stats.percentileMs(50);
+    AuxStatsN[STATS_RTT_P95].value         = stats.percentileMs(95);
+    AuxStatsN[STATS_RTT_P99].value         = stats.percentileMs(99);
+
+    // How far the event loop has fallen behind the mount's announcements since we connected.
+    uint64_t overflows                     = m_bus.unsolicitedOverflows();
+    AuxStatsN[STATS_QUEUE_PEAK].value      = m_bus.unsolicitedHighWater();
+    AuxStatsN[STATS_QUEUE_OVERFLOWS].value = overflows;
+
+    // A timeout, a bad frame or a dropped announcement is worth a second look; the bus otherwise
+    // looks healthy.
+    AuxStatsNP.s = total.timeouts > m_statsTotals.timeouts ||
+                           total.checksumErrors > m_statsTotals.checksumErrors ||
+                           overflows > m_statsOverflows
+                       ? IPS_ALERT
+                       : IPS_OK;
+    IDSetNumber(&AuxStatsNP, nullptr);
+
+    for (int i = 0; i < STATS_COMMAND_COUNT; i++)
+    {
+        AuxLatencyN[i * 3 + 0].value = stats.percentileMs(STATS_COMMANDS[i], 50);
+        AuxLatencyN[i * 3 + 1].value = stats.percentileMs(STATS_COMMANDS[i], 95);
+        AuxLatencyN[i * 3 + 2].value = stats.percentileMs(STATS_COMMANDS[i], 99);
+    }
+    AuxLatencyNP.s = IPS_OK;
+    IDSetNumber(&AuxLatencyNP, nullptr);
+
+    for (int l = 0; l < LANE_COUNT; l++)
+    {
+        AuxLanesN[l * 2 + 0].value = stats.queuePercentileMs(static_cast<AUXLane>(l), 50);
+        AuxLanesN[l * 2 + 1].value = stats.queuePercentileMs(static_cast<AUXLane>(l), 99);
+    }
+    AuxLanesN[LANE_COUNT * 2].value = stats.skips(LANE_POLL);
+    AuxLanesNP.s                    = IPS_OK;
+    IDSetNumber(&AuxLanesNP, nullptr);
+
+    m_statsTotals    = total;
+    m_statsOverflows = overflows;
+    m_statsPublished = now;
+}
+
+bool CelestronCGX::updateTrace()
+{
+    if (TraceS[1].s == ISS_ON)
+    {
+        if (m_trace.recording())
+        {
+            LOGF_INFO("Stopped recording the wire trace to %s.", m_trace.path().c_str());
+        }
+        m_trace.stop();
+        return true;
+    }
+
+    // Once open, the file stays mapped until disconnect: the bus thread may be writing into it.
+    if (!m_trace.isOpen() && !m_trace.open(TraceFileT[0].text))
+    {
+        LOGF_ERROR("Can't open wire trace %s: %s", TraceFileT[0].text, strerror(errno));
+        return false;
+    }
+
+    m_trace.start();
+    LOGF_INFO("Recording the wire trace to %s.", m_trace.path().c_str());
+
+    return true;
+}
+
+PollScheduler::MountState CelestronCGX::mountState()
+{
+    if (AlignSP.s == IPS_BUSY)
+    {
+        return PollScheduler::MOUNT_HOMING;
+    }
+
+    if (TrackState == SCOPE_SLEWING || TrackState == SCOPE_PARKING)
+    {
+        return PollScheduler::MOUNT_SLEWING;
+    }
+
+    if (GuideNSNP.s == IPS_BUSY || GuideWENP.s == IPS_BUSY)
+    {
+        return PollScheduler::MOUNT_GUIDING;
+    }
+
+    switch (TrackState)
+    {
+    case SCOPE_PARKED:
+        return PollScheduler::MOUNT_PARKED;
+    case SCOPE_TRACKING:
+        return PollScheduler::MOUNT_TRACKING;
+    default:
+        return PollScheduler::MOUNT_IDLE;
+    }
+}
+
+bool CelestronCGX::Goto(double r, double d)
+{
+    StartSlew(r, d, SCOPE_SLEWING);
+    return true;
+}
+
+bool CelestronCGX::Abort()
+{
+    if (MovementNSSP.s == IPS_BUSY)
+    {
+        MovementNSSP.s = IPS_IDLE;
+        IUResetSwitch(&MovementNSSP);
+        IDSetSwitch(&MovementNSSP, nullptr);
+    }
+
+    if (MovementWESP.s == IPS_BUSY)
+    {
+        MovementWESP.s = IPS_IDLE;
+        IUResetSwitch(&MovementWESP);
+        IDSetSwitch(&MovementWESP, nullptr);
+    }
+
+    if (EqNP.s == IPS_BUSY)
+    {
+        EqNP.s = IPS_IDLE;
+        IDSetNumber(&EqNP, nullptr);
+    }
+
+    TrackState = SCOPE_IDLE;
+    clearSlewTarget();
+    m_finalApproach = false;
+    m_slewModel.cancel();
+    m_gotoSequence++;
+    m_etaPublisher.set(0, 0);
+    m_etaPublisher.setState(IPS_IDLE);
+
+    cancelGuiding();
+    sendCmds({ auxRateCommand<MC_MOVE_POS, DEC>(0), auxRateCommand<MC_MOVE_POS, RA>(0) },
+             LANE_URGENT);
+
+    m_predictor.setRate(AXIS_RA, 0, EncoderPredictor::Clock::now());
+    m_predictor.setRate(AXIS_DE, 0, EncoderPredictor::Clock::now());
+
+    return true;
+}
+
+bool CelestronCGX::Park()
+{
+    SetTrackEnabled(false);
 
     double hourAngle = GetAxis1Park();
     double dec       = GetAxis2Park();
@@ -762,6 +1596,9 @@ bool CelestronCGX::SetTrackEnabled(bool enabled)
 
         TrackState = SCOPE_TRACKING;
 
+        m_predictor.setRate(AXIS_RA, trackingRate(), EncoderPredictor::Clock::now());
+        m_predictor.setRate(AXIS_DE, 0, EncoderPredictor::Clock::now());
+
         return sendCmd(AUXCommand(MC_SET_POS_GUIDERATE, ANY, RA, data));
     }
     else
@@ -773,12 +1610,30 @@ bool CelestronCGX::SetTrackEnabled(bool enabled)
 
         TrackState = SCOPE_IDLE;
 
+        m_predictor.setRate(AXIS_RA, 0, EncoderPredictor::Clock::now());
+
         return sendCmd(AUXCommand(MC_SET_POS_GUIDERATE, ANY, RA, data));
     }
 
     return true;
 }
 
+double CelestronCGX::trackingRate()
+{
+    TelescopeTrackMode mode = static_cast<TelescopeTrackMode>(IUFindOnSwitchIndex(&TrackModeSP));
+
+    // Hour angle advances one turn per sidereal day, solar day or lunar day.
+    switch (mode)
+    {
+    case TRACK_SOLAR:
+        return STEPS_PER_REVOLUTION / 86400.0;
+    case TRACK_LUNAR:
+        return STEPS_PER_REVOLUTION / 89428.3;
+    default:
+        return STEPS_PER_REVOLUTION / 86164.0905;
+    }
+}
+
 bool CelestronCGX::SetCurrentPark()
 {
     EQAlignment::TelescopePierSide pierSide;
@@ -818,6 +1673,31 @@ bool CelestronCGX::SetParkPosition(double Axis1Value, double Axis2Value)
 
 bool CelestronCGX::Sync(double ra, double dec)
 {
+    if (PointingModelS[0].s == ISS_ON)
+    {
+        // A point needs to know where the encoders are.
+        if (!m_predictor.sampled(AXIS_RA) || !m_predictor.sampled(AXIS_DE))
+        {
+            LOG_ERROR("Mount position not read yet; sync again in a moment.");
+            return false;
+        }
+
+        // The encoders carry on counting from the index, and the model takes up the difference.
+        EncoderPredictor::Clock::time_point now = EncoderPredictor::Clock::now();
+        uint32_t raSteps                        = m_predictor.predict(AXIS_RA, now);
+        uint32_t decSteps                       = m_predictor.predict(AXIS_DE, now);
+
+        m_pointingModel.addPoint(m_alignment.localSiderealTime() - ra, dec, raSteps, decSteps);
+
+        LOGF_INFO("sync point %d: ra %0.3f; dec %0.3f; stepsRa %u; stepsDec %u;",
+                  static_cast<int>(m_pointingModel.size()), ra, dec, raSteps, decSteps);
+
+        PointingTermsNP.s = IPS_BUSY;
+        IDSetNumber(&PointingTermsNP, nullptr);
+
+        return true;
+    }
+
     EQAlignment::TelescopePierSide pierSide;
     uint32_t raSteps, decSteps;
 
@@ -825,25 +1705,178 @@ bool CelestronCGX::Sync(double ra, double dec)
 
     setPierSide(static_cast<TelescopePierSide>(pierSide));
 
-    AUXCommand raCmd(MC_SET_POSITION, ANY, RA);
-    raCmd.setPosition(raSteps);
-    sendCmd(raCmd);
-
-    AUXCommand decCmd(MC_SET_POSITION, ANY, DEC);
-    decCmd.setPosition(decSteps);
-    sendCmd(decCmd);
+    sendCmds({ auxPositionCommand<MC_SET_POSITION, RA>(raSteps),
+               auxPositionCommand<MC_SET_POSITION, DEC>(decSteps) });
+    m_predictor.reset();
 
     LOGF_INFO("sync: ra %0.3f; dec %0.3f; stepsRa %d; stepsDec %d;", ra, dec, raSteps, decSteps);
 
+    // The encoders no longer count from where the sync points were taken.
+    if (m_pointingModel.size() > 0)
+    {
+        clearPointingModel();
+    }
+
     // Be sure to update our local status.
-    getDec();
-    getRA();
+    getPositions();
 
     return true;
 }
 
 // common code for GoTo and park
-void CelestronCGX::StartSlew(double ra, double dec, TelescopeStatus status, bool skipPierSideCheck)
+double CelestronCGX::stepsBetween(uint32_t to, double from)
+{
+    int64_t steps = (static_cast<int64_t>(to) - static_cast<int64_t>(from)) &
+                    (STEPS_PER_REVOLUTION - 1);
+    return static_cast<double>(steps >= STEPS_PER_REVOLUTION / 2 ? steps - STEPS_PER_REVOLUTION
+                                                                 : steps);
+}
+
+void CelestronCGX::driveToWaypoint()
+{
+    uint32_t fromRA  = static_cast<uint32_t>(EncoderTicksN[AXIS_RA].value);
+    uint32_t fromDec = static_cast<uint32_t>(EncoderTicksN[AXIS_DE].value);
+
+    // The last waypoint is where the target was when planned. A slow leg makes up for the sky
+    // moving on meanwhile.
+    double seconds = planSeconds(m_nextWaypoint, fromRA, fromDec);
+    setSlewEta(seconds + m_slewModel.seconds(AXIS_RA, trackingRate() * seconds, false));
+
+    const SlewPlanner::Waypoint &waypoint = m_slewPlanner[m_nextWaypoint++];
+
+    sendCmds({ auxPositionCommand<MC_GOTO_FAST, RA>(waypoint.ra),
+               auxPositionCommand<MC_GOTO_FAST, DEC>(waypoint.dec) });
+    startLegs(waypoint.ra, waypoint.dec, SlewModel::LEG_FAST);
+
+    m_predictor.setRateUnknown(AXIS_RA);
+    m_predictor.setRateUnknown(AXIS_DE);
+
+    m_raSlewing  = true;
+    m_decSlewing = true;
+    m_manualSlew = false;
+    m_raLegDone  = false;
+    m_decLegDone = false;
+    m_gotoSequence++;
+
+    LOGF_DEBUG("Waypoint %d: %u, %u", static_cast<int>(m_nextWaypoint), waypoint.ra, waypoint.dec);
+}
+
+void CelestronCGX::clearSlewTarget()
+{
+    delete m_raTarget;
+    delete m_decTarget;
+    m_raTarget  = nullptr;
+    m_decTarget = nullptr;
+}
+
+EQAlignment::TelescopePierSide CelestronCGX::fasterPierSide(double ra, double dec, uint32_t fromRA,
+                                                            uint32_t fromDec)
+{
+    EQAlignment::TelescopePierSide side  = m_alignment.expectedPierSide(ra);
+    EQAlignment::TelescopePierSide other = side == EQAlignment::PIER_WEST ? EQAlignment::PIER_EAST
+                                                                          : EQAlignment::PIER_WEST;
+
+    uint32_t raSteps, decSteps, otherRA, otherDec;
+    m_alignment.EncoderValuesFromRADec(ra, dec, side, raSteps, decSteps);
+    m_alignment.EncoderValuesFromRADec(ra, dec, other, otherRA, otherDec);
+
+    // Tracking turns the RA encoder up. Below home that brings the counterweight down, so the
+    // other side is good for the rest of the night; above home it would only rise on towards the
+    // cordwrap. That leaves targets still east of the meridian, and the planner's counterweight
+    // limit says how far east.
+    if (stepsBetween(otherRA, m_alignment.GetStepsAtHomePositionRA()) >= 0)
+    {
+        return side;
+    }
+
+    if (!m_slewPlanner.plan(fromRA, fromDec, otherRA, otherDec))
+    {
+        return side;
+    }
+    double otherSeconds = planSeconds(0, fromRA, fromDec);
+
+    if (m_slewPlanner.plan(fromRA, fromDec, raSteps, decSteps))
+    {
+        double seconds = planSeconds(0, fromRA, fromDec);
+        if (seconds <= otherSeconds)
+        {
+            return side;
+        }
+
+        LOGF_INFO("Pier %s is %.0f s quicker than pier %s",
+                  other == EQAlignment::PIER_WEST ? "west" : "east", seconds - otherSeconds,
+                  side == EQAlignment::PIER_WEST ? "west" : "east");
+    }
+
+    return other;
+}
+
+double CelestronCGX::planSeconds(size_t first, uint32_t fromRA, uint32_t fromDec)
+{
+    double seconds = 0;
+
+    for (size_t i = first; i < m_slewPlanner.size(); i++)
+    {
+        const SlewPlanner::Waypoint &waypoint = m_slewPlanner[i];
+
+        seconds += m_slewModel.seconds(stepsBetween(waypoint.ra, fromRA),
+                                       stepsBetween(waypoint.dec, fromDec), true);
+        fromRA  = waypoint.ra;
+        fromDec = waypoint.dec;
+    }
+
+    return seconds;
+}
+
+void CelestronCGX::startLegs(uint32_t raSteps, uint32_t decSteps, SlewModel::Leg leg)
+{
+    SlewModel::Clock::time_point now = SlewModel::Clock::now();
+
+    m_slewModel.started(AXIS_RA, stepsBetween(raSteps, EncoderTicksN[AXIS_RA].value), leg, now);
+    m_slewModel.started(AXIS_DE, stepsBetween(decSteps, EncoderTicksN[AXIS_DE].value), leg, now);
+}
+
+void CelestronCGX::setSlewEta(double seconds)
+{
+    m_slewArrival = SlewModel::Clock::now() +
+                    std::chrono::duration_cast<SlewModel::Clock::duration>(
+                        std::chrono::duration<double>(seconds));
+
+    m_etaPublisher.set(0, seconds);
+    m_etaPublisher.setState(IPS_BUSY);
+}
+
+void CelestronCGX::fillSlewModel()
+{
+    for (int a = 0; a < SlewModel::AXES; a++)
+    {
+        const SlewModel::Axis &axis = m_slewModel.axis(a);
+        INumber *n                  = &SlewModelN[a * 4];
+
+        n[0].value = axis.acceleration / STEPS_PER_DEGREE;
+        n[1].value = axis.fastRate / STEPS_PER_DEGREE;
+        n[2].value = axis.slowRate / STEPS_PER_DEGREE;
+        n[3].value = axis.approach;
+    }
+}
+
+void CelestronCGX::applySlewModel()
+{
+    for (int a = 0; a < SlewModel::AXES; a++)
+    {
+        const INumber *n = &SlewModelN[a * 4];
+        SlewModel::Axis axis;
+
+        axis.acceleration = n[0].value * STEPS_PER_DEGREE;
+        axis.fastRate     = n[1].value * STEPS_PER_DEGREE;
+        axis.slowRate     = n[2].value * STEPS_PER_DEGREE;
+        axis.approach     = n[3].value;
+
+        m_slewModel.setAxis(a, axis);
+    }
+}
+
+void CelestronCGX::StartSlew(double ra, double dec, TelescopeStatus status, bool direct)
 {
     const char *statusStr;
     switch (status)
@@ -860,34 +1893,60 @@ void CelestronCGX::StartSlew(double ra, double dec, TelescopeStatus status, bool
     RememberTrackState = TrackState;
     TrackState         = status;
 
-    EQAlignment::TelescopePierSide pierSide;
-    uint32_t raSteps, decSteps;
-
-    m_alignment.EncoderValuesFromRADec(ra, dec, raSteps, decSteps, pierSide);
-
     double currentRASteps  = EncoderTicksN[AXIS_RA].value;
     double currentDecSteps = EncoderTicksN[AXIS_DE].value;
 
-    if (!skipPierSideCheck && currentPierSide != static_cast<TelescopePierSide>(pierSide))
+    // The side is settled when the goto starts, so the later legs of it don't flip over if the
+    // target crosses the meridian meanwhile.
+    if (!direct)
     {
-        // The mount will take the shortest distance to the new stepper count, so make sure we go
-        // through home if we would otherwise do something crazy do something crazy.
+        m_targetPierSide = status == SCOPE_SLEWING
+                               ? fasterPierSide(ra, dec, static_cast<uint32_t>(currentRASteps),
+                                                static_cast<uint32_t>(currentDecSteps))
+                               : m_alignment.expectedPierSide(ra);
+    }
 
-        if (std::abs(long(raSteps) - long(currentRASteps)) > long(STEPS_PER_REVOLUTION / 2) ||
-            std::abs(long(decSteps) - long(currentDecSteps)) > long(STEPS_PER_REVOLUTION / 2))
+    uint32_t raSteps, decSteps;
+    m_alignment.EncoderValuesFromRADec(ra, dec, m_targetPierSide, raSteps, decSteps);
+
+    if (!direct)
+    {
+        // The mount takes the shortest way to the new stepper count, which can be the wrong way
+        // round. Plan legs it can't get wrong.
+        clearSlewTarget();
+        m_finalApproach = false;
+        m_slewModel.cancel();
+
+        if (!m_slewPlanner.plan(static_cast<uint32_t>(currentRASteps),
+                                static_cast<uint32_t>(currentDecSteps), raSteps, decSteps))
         {
             m_raTarget  = new double(ra);
             m_decTarget = new double(dec);
 
-            // Let's go back to home since we are changing pier sides. The mount otherwise wants to
-            // take shortest distance, which can be wrong.
-            // Takes a little longer to slew, but keeps things simple.
-
+            // No safe way there from where the encoders say we are, e.g. past the cordwrap. Find
+            // home by the index and go from there, which takes minutes but can't go wrong.
             LOGF_INFO("%s to home, then to %f %f, %d, %d", statusStr, ra, dec, raSteps, decSteps);
 
+            // The index search takes as long as it takes.
+            m_etaPublisher.set(0, 0);
+            m_etaPublisher.setState(IPS_IDLE);
+
             startAlign();
             return;
         }
+
+        if (m_slewPlanner.size() > 1)
+        {
+            m_raTarget     = new double(ra);
+            m_decTarget    = new double(dec);
+            m_nextWaypoint = 0;
+
+            LOGF_INFO("%s to %f %f in %d legs", statusStr, ra, dec,
+                      static_cast<int>(m_slewPlanner.size()));
+
+            driveToWaypoint();
+            return;
+        }
     }
 
     bool raClose, decClose = false;
@@ -895,19 +1954,65 @@ void CelestronCGX::StartSlew(double ra, double dec, TelescopeStatus status, bool
     raClose  = std::abs(long(raSteps) - long(currentRASteps)) < long(STEPS_PER_DEGREE * 4);
     decClose = std::abs(long(decSteps) - long(currentDecSteps)) < long(STEPS_PER_DEGREE * 4);
 
-    AUXCommands cmd = raClose && decClose ? MC_GOTO_SLOW : MC_GOTO_FAST;
+    bool approach   = m_finalApproach;
+    bool fast       = !approach && !(raClose && decClose);
+    m_finalApproach = false;
+
+    double seconds = m_slewModel.seconds(stepsBetween(raSteps, currentRASteps),
+                                         stepsBetween(decSteps, currentDecSteps), fast);
+
+    // Parking aims at an hour angle rather than a star, so there is nothing to lead.
+    if (status == SCOPE_SLEWING)
+    {
+        // The star moves on while the motors turn, so aim where it will be when they get there.
+        // The RA encoder counts hour angle, which just carries on at the sidereal rate. Once more
+        // round is enough for the distance added by the lead itself.
+        uint32_t aim = raSteps;
+        for (int i = 0; i < 2; i++)
+        {
+            aim     = raSteps + static_cast<uint32_t>(STEPS_PER_REVOLUTION / 86164.0905 * seconds);
+            seconds = m_slewModel.seconds(stepsBetween(aim, currentRASteps),
+                                          stepsBetween(decSteps, currentDecSteps), fast);
+        }
+        raSteps = aim & (STEPS_PER_REVOLUTION - 1);
+
+        // A fast leg ends wherever its estimate said. A slow one, aimed afresh on arrival, takes
+        // it the rest of the way.
+        if (fast)
+        {
+            m_raTarget      = new double(ra);
+            m_decTarget     = new double(dec);
+            m_finalApproach = true;
+        }
+    }
+
+    AUXCommands cmd = fast ? MC_GOTO_FAST : MC_GOTO_SLOW;
 
     AUXCommand raCmd(cmd, ANY, RA);
     raCmd.setPosition(raSteps);
-    sendCmd(raCmd);
 
     AUXCommand decCmd(cmd, ANY, DEC);
     decCmd.setPosition(decSteps);
-    sendCmd(decCmd);
 
+    sendCmds({ raCmd, decCmd });
+    startLegs(raSteps, decSteps, fast       ? SlewModel::LEG_FAST
+                                 : approach ? SlewModel::LEG_APPROACH
+                                            : SlewModel::LEG_SLOW);
+    setSlewEta(m_finalApproach ? seconds + m_slewModel.approachSeconds() : seconds);
+
+    m_predictor.setRateUnknown(AXIS_RA);
+    m_predictor.setRateUnknown(AXIS_DE);
+
+    // Until each motor reports SLEW_DONE, so one axis finishing first doesn't end the slew.
+    m_raSlewing  = true;
+    m_decSlewing = true;
     m_manualSlew = false;
+    m_raLegDone  = false;
+    m_decLegDone = false;
+    m_gotoSequence++;
 
-    LOGF_INFO("%s to %f %f %d, %d, %d", statusStr, ra, dec, cmd, raSteps, decSteps);
+    LOGF_INFO("%s to %f %f %d, %d, %d, arriving in %.1f s", statusStr, ra, dec, cmd, raSteps,
+              decSteps, seconds);
 }
 
 uint8_t CelestronCGX::slewRate()
@@ -938,6 +2043,8 @@ bool CelestronCGX::MoveNS(INDI_DIR_NS dir, TelescopeMotionCommand command)
     }
 
     m_manualSlew = true;
+    m_predictor.setRateUnknown(AXIS_DE);
+    m_slewModel.cancel();
 
     buffer dat(1);
     dat[0] = 0x00;
@@ -964,6 +2071,8 @@ bool CelestronCGX::MoveWE(INDI_DIR_WE dir, TelescopeMotionCommand command)
     }
 
     m_manualSlew = true;
+    m_predictor.setRateUnknown(AXIS_RA);
+    m_slewModel.cancel();
 
     buffer dat(1);
     dat[0] = 0x00;
@@ -985,6 +2094,12 @@ bool CelestronCGX::saveConfigItems(FILE *fp)
 {
     INDI::Telescope::saveConfigItems(fp);
 
+    IUSaveConfigNumber(fp, &PublishRateNP);
+    IUSaveConfigNumber(fp, &SlewModelNP);
+    IUSaveConfigSwitch(fp, &PointingModelSP);
+    IUSaveConfigText(fp, &TraceFileTP);
+    IUSaveConfigSwitch(fp, &TraceSP);
+
     return true;
 }
 
@@ -993,6 +2108,7 @@ bool CelestronCGX::updateLocation(double latitude, double longitude, double elev
     LOGF_INFO("Update location %8.3f, %8.3f, %4.0f", latitude, longitude, elevation);
 
     m_alignment.UpdateLongitude(longitude);
+    m_pointingModel.setLatitude(latitude);
 
     return true;
 }
@@ -1002,68 +2118,162 @@ bool CelestronCGX::updateLocation(double latitude, double longitude, double elev
 
 IPState CelestronCGX::GuideNorth(uint32_t ms)
 {
-    LOGF_DEBUG("Guiding: N %.0f ms", ms);
-
-    uint8_t ticks = std::min(uint32_t(255), ms / 10);
-
-    int8_t rate = static_cast<int8_t>(GuideRateN[AXIS_DE].value);
+    LOGF_DEBUG("Guiding: N %u ms", ms);
+    return guide(AXIS_DE, static_cast<int32_t>(ms));
+}
 
-    buffer data(2);
-    data[0] = rate;
-    data[1] = ticks;
+IPState CelestronCGX::GuideSouth(uint32_t ms)
+{
+    LOGF_DEBUG("Guiding: S %u ms", ms);
+    return guide(AXIS_DE, -static_cast<int32_t>(ms));
+}
 
-    sendCmd(AUXCommand(MC_AUX_GUIDE, ANY, DEC, data));
+IPState CelestronCGX::GuideEast(uint32_t ms)
+{
+    LOGF_DEBUG("Guiding: E %u ms", ms);
+    return guide(AXIS_RA, -static_cast<int32_t>(ms));
+}
 
-    return IPS_BUSY;
+IPState CelestronCGX::GuideWest(uint32_t ms)
+{
+    LOGF_DEBUG("Guiding: W %u ms", ms);
+    return guide(AXIS_RA, static_cast<int32_t>(ms));
 }
 
-IPState CelestronCGX::GuideSouth(uint32_t ms)
+IPState CelestronCGX::guide(INDI_EQ_AXIS axis, int32_t ms)
 {
-    LOGF_DEBUG("Guiding: S %.0f ms", ms);
+    // A new pulse replaces what is left of the last one on this axis.
+    GuideTimer &timer = m_guideTimers[axis];
+    if (timer.id != -1)
+    {
+        IERmTimer(timer.id);
+        timer.id = -1;
+    }
 
-    uint8_t ticks = std::min(uint32_t(255), ms / 10);
+    GuidePulser &pulser = m_pulsers[axis];
 
-    int8_t rate = static_cast<int8_t>(GuideRateN[AXIS_DE].value);
+    // The pulse being replaced ends short of what it planned.
+    if (pulser.pending())
+    {
+        publishGuideDelivered(axis);
+    }
+
+    int32_t planned = pulser.start(ms);
 
-    buffer data(2);
-    data[0] = -rate;
-    data[1] = ticks;
+    LOGF_DEBUG("Guiding: delivering %d ms, %.1f ms carried to the next pulse", planned,
+               pulser.carried());
+
+    // Less than a tick, all of it carried over.
+    if (!pulser.pending())
+    {
+        publishGuideDelivered(axis);
+        return IPS_OK;
+    }
 
-    sendCmd(AUXCommand(MC_AUX_GUIDE, ANY, DEC, data));
+    m_predictor.setRateUnknown(axis);
+
+    // Held back until the event loop has dealt with whatever arrived along with it. A guider
+    // correcting both axes sets both properties at once, and the two pulses then go out in one
+    // burst instead of a round trip apart.
+    timer.due = true;
+    if (m_guideFlushID == -1)
+    {
+        m_guideFlushID = IEAddTimer(0, guideFlushCallback, this);
+    }
 
     return IPS_BUSY;
 }
 
-IPState CelestronCGX::GuideEast(uint32_t ms)
+void CelestronCGX::sendGuideSegments()
 {
-    LOGF_DEBUG("Guiding: E %.0f ms", ms);
+    GuidePulser::Clock::time_point now = GuidePulser::Clock::now();
+    AUXBatch segments;
 
-    uint8_t ticks = std::min(uint32_t(255), ms / 10);
+    for (int axis = 0; axis < 2; axis++)
+    {
+        GuideTimer &timer = m_guideTimers[axis];
+        if (!timer.due)
+        {
+            continue;
+        }
+        timer.due = false;
 
-    int8_t rate = static_cast<int8_t>(GuideRateN[AXIS_RA].value);
+        GuidePulser::Segment segment;
+        if (!m_pulsers[axis].next(segment, now))
+        {
+            continue;
+        }
 
-    buffer data(2);
-    data[0] = -rate;
-    data[1] = ticks;
+        // Armed before the send, so the round trip doesn't open a gap between segments.
+        if (m_pulsers[axis].pending())
+        {
+            timer.id = IEAddTimer(segment.ms(), guideTimerCallback, &timer);
+        }
+        else
+        {
+            publishGuideDelivered(axis);
+        }
 
-    sendCmd(AUXCommand(MC_AUX_GUIDE, ANY, RA, data));
+        buffer data(2);
+        data[0] = static_cast<int8_t>(segment.sign * GuideRateN[axis].value);
+        data[1] = segment.ticks;
 
-    return IPS_BUSY;
+        segments.push_back(AUXCommand(MC_AUX_GUIDE, ANY, axis == AXIS_RA ? RA : DEC, data));
+    }
+
+    // An urgent send drops the queued polls, so don't make one for nothing.
+    if (segments.size() == 0)
+    {
+        return;
+    }
+
+    sendCmds(segments, LANE_URGENT);
 }
 
-IPState CelestronCGX::GuideWest(uint32_t ms)
+void CelestronCGX::guideFlushCallback(void *p)
 {
-    LOGF_DEBUG("Guiding: W %.0f ms", ms);
+    CelestronCGX *driver   = static_cast<CelestronCGX *>(p);
+    driver->m_guideFlushID = -1;
+    driver->sendGuideSegments();
+}
 
-    uint8_t ticks = std::min(uint32_t(255), ms / 10);
+void CelestronCGX::guideTimerCallback(void *p)
+{
+    GuideTimer *timer = static_cast<GuideTimer *>(p);
+    timer->id         = -1;
+    timer->due        = true;
+    timer->driver->sendGuideSegments();
+}
 
-    int8_t rate = static_cast<int8_t>(GuideRateN[AXIS_RA].value);
+void CelestronCGX::cancelGuiding()
+{
+    if (m_guideFlushID != -1)
+    {
+        IERmTimer(m_guideFlushID);
+        m_guideFlushID = -1;
+    }
 
-    buffer data(2);
-    data[0] = rate;
-    data[1] = ticks;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (m_guideTimers[axis].id != -1)
+        {
+            IERmTimer(m_guideTimers[axis].id);
+            m_guideTimers[axis].id = -1;
+        }
+        m_guideTimers[axis].due = false;
 
-    sendCmd(AUXCommand(MC_AUX_GUIDE, ANY, RA, data));
+        bool cutShort = m_pulsers[axis].pending();
+        m_pulsers[axis].cancel();
+        if (cutShort)
+        {
+            publishGuideDelivered(axis);
+        }
+    }
+}
 
-    return IPS_BUSY;
+void CelestronCGX::publishGuideDelivered(int axis)
+{
+    GuideDeliveredN[axis].value = m_pulsers[axis].delivered();
+    GuideDeliveredNP.s          = IPS_OK;
+    IDSetNumber(&GuideDeliveredNP, nullptr);
 }
@@ -22,8 +22,17 @@
 #include <libindi/indiguiderinterface.h>
 #include <libindi/inditelescope.h>
 
+#include "auxbus.h"
+#include "auxdispatcher.h"
 #include "auxproto.h"
-#include "simplealignment.h"
+#include "encoderpredictor.h"
+#include "fixedalignment.h"
+#include "guidepulser.h"
+#include "numberpublisher.h"
+#include "pointingmodel.h"
+#include "pollscheduler.h"
+#include "slewmodel.h"
+#include "slewplanner.h"
 
 /**
  * @brief The CelestronCGX class provides a simple mount simulator of an equatorial mount.
@@ -93,11 +102,11 @@ class CelestronCGX : public INDI::Telescope, public INDI::GuiderInterface
     virtual bool saveConfigItems(FILE *fp) override;
 
   private:
-    static const uint32_t STEPS_PER_REVOLUTION;
+    static const uint32_t STEPS_PER_REVOLUTION = 0x1000000;
     static const double STEPS_PER_DEGREE;
 
-    /// used by GoTo and Park
-    void StartSlew(double ra, double dec, TelescopeStatus status, bool skipPierSideCheck = false);
+    /// used by GoTo and Park. direct skips planning, when the way there was planned already.
+    void StartSlew(double ra, double dec, TelescopeStatus status, bool direct = false);
 
     INumber LocationDebugN[2];
     INumberVectorProperty LocationDebugNP;
@@ -108,9 +117,72 @@ class CelestronCGX : public INDI::Telescope, public INDI::GuiderInterface
     INumber GuideRateN[2];
     INumberVectorProperty GuideRateNP;
 
+    // What the last pulse on each axis delivered, in ms: positive north or west.
+    INumber GuideDeliveredN[2];
+    INumberVectorProperty GuideDeliveredNP;
+
+    // Seconds until the goto under way is expected to arrive.
+    INumber SlewEtaN[1];
+    INumberVectorProperty SlewEtaNP;
+
+    // SlewModel's figures for each axis, in degrees and seconds: acceleration, fast rate, slow
+    // rate and approach time, RA first.
+    INumber SlewModelN[SlewModel::AXES * 4];
+    INumberVectorProperty SlewModelNP;
+
+    INumber BusBandwidthN[PollScheduler::MOUNT_STATE_COUNT];
+    INumberVectorProperty BusBandwidthNP;
+
+    INumber PublishRateN[1];
+    INumberVectorProperty PublishRateNP;
+
+    enum
+    {
+        STATS_REQUESTS,
+        STATS_BYTES_OUT,
+        STATS_BYTES_IN,
+        STATS_TIMEOUTS,
+        STATS_CHECKSUM_ERRORS,
+        STATS_RESYNCS,
+        STATS_RTT_P50,
+        STATS_RTT_P95,
+        STATS_RTT_P99,
+        STATS_QUEUE_PEAK,
+        STATS_QUEUE_OVERFLOWS,
+        STATS_COUNT
+    };
+    INumber AuxStatsN[STATS_COUNT];
+    INumberVectorProperty AuxStatsNP;
+
+    // p50, p95 and p99 round trip for each of the commands in STATS_COMMANDS.
+    static const int STATS_COMMAND_COUNT = 8;
+    INumber AuxLatencyN[STATS_COMMAND_COUNT * 3];
+    INumberVectorProperty AuxLatencyNP;
+
+    // p50 and p99 queueing delay for each AUXLane, then the polls urgent commands skipped.
+    INumber AuxLanesN[LANE_COUNT * 2 + 1];
+    INumberVectorProperty AuxLanesNP;
+
+    ISwitch TraceS[2];
+    ISwitchVectorProperty TraceSP;
+
+    IText TraceFileT[1];
+    ITextVectorProperty TraceFileTP;
+
     ISwitch AlignS[1];
     ISwitchVectorProperty AlignSP;
 
+    // Whether a sync adds a point to the pointing model or sets the encoders.
+    ISwitch PointingModelS[2];
+    ISwitchVectorProperty PointingModelSP;
+
+    ISwitch PointingClearS[1];
+    ISwitchVectorProperty PointingClearSP;
+
+    // The fitted terms in arc minutes, then the points and the fit's rms in arc seconds.
+    INumber PointingTermsN[PointingTerms::TERM_COUNT + 2];
+    INumberVectorProperty PointingTermsNP;
+
     IText VersionT[3];
     ITextVectorProperty VersionTP;
 
@@ -123,17 +195,142 @@ class CelestronCGX : public INDI::Telescope, public INDI::GuiderInterface
 
     bool m_raSlewing{false};
     bool m_decSlewing{false};
+    // Each axis has reported SLEW_DONE since the leg under way was sent. Only a new leg clears
+    // them, so they are what a planned slew waits on before the next one.
+    bool m_raLegDone{false};
+    bool m_decLegDone{false};
+    // Bumped by every goto and abort. A SLEW_DONE poll posted before the latest one may have been
+    // answered before the motors took the goto, so its reply says nothing about it.
+    uint32_t m_gotoSequence{0};
 
+    // Where a slew that goes by way of home or of waypoints ends up.
     double *m_raTarget{nullptr};
     double *m_decTarget{nullptr};
+    size_t m_nextWaypoint{0};
+    // The next slew to the stored target is the slow one that finishes a lead-compensated goto.
+    bool m_finalApproach{false};
+    // The side of the pier the goto under way ends on.
+    EQAlignment::TelescopePierSide m_targetPierSide{EQAlignment::PIER_WEST};
+    SlewModel::Clock::time_point m_slewArrival;
 
     bool startAlign();
-    bool getDec();
-    bool getRA();
+    void checkAlignComplete();
+    void checkSlewComplete();
+    // Sends the next waypoint of m_slewPlanner's plan.
+    void driveToWaypoint();
+    void clearSlewTarget();
+    // The side the hour angle calls for, unless the target is close enough to the meridian to be
+    // reached sooner from the other side.
+    EQAlignment::TelescopePierSide fasterPierSide(double ra, double dec, uint32_t fromRA,
+                                                  uint32_t fromDec);
+    // Seconds to drive m_slewPlanner's plan at GOTO_FAST, from a waypoint onwards.
+    double planSeconds(size_t first, uint32_t fromRA, uint32_t fromDec);
+    // Starts timing a goto leg on both axes for the SlewModel, from where the encoders are.
+    void startLegs(uint32_t raSteps, uint32_t decSteps, SlewModel::Leg leg);
+    void setSlewEta(double seconds);
+    // SlewModelNP from m_slewModel and back.
+    void fillSlewModel();
+    void applySlewModel();
+    // Shortest way from one encoder count to another, in steps either way.
+    static double stepsBetween(uint32_t to, double from);
+    bool getPositions();
+
+    bool sendCmd(const AUXCommand &cmd, AUXLane lane = LANE_MOTION);
+    // Queues all commands before waiting, so they go out in one burst and their round trips
+    // overlap.
+    bool sendCmds(const AUXBatch &cmds, AUXLane lane = LANE_MOTION);
+    bool awaitReply(AUXBus::Ticket ticket);
+    bool handleCommand(const AUXCommand &cmd);
+
+    // Runs on the INDI thread whenever the bus queues a frame we didn't ask for or finishes a
+    // posted poll.
+    static void unsolicitedCallback(int fd, void *p);
+    // Stops the event loop watching the bus, if it is.
+    void removeUnsolicitedCallback();
+    // Undoes a Handshake that got as far as starting the bus. Returns false, for returning.
+    bool abandonHandshake();
+    void processUnsolicited();
+
+    // The status polls of one ReadScopeStatus go out on LANE_POLL without blocking the event
+    // loop, so a guide pulse or an abort can overtake them. The cycle finishes once every reply
+    // is in.
+    void postPoll(const AUXCommand &cmd, PollScheduler::Query query);
+    void collectPolls();
+    void finishPollCycle();
+    void dropPollCycle();
+
+    PollScheduler::MountState mountState();
+
+    // Starts a pulse on one axis, ms signed like GuidePulser's.
+    IPState guide(INDI_EQ_AXIS axis, int32_t ms);
+    // Sends the next segment on every axis that has one due, all in one burst, and arms the
+    // timers for the segments after.
+    void sendGuideSegments();
+    static void guideFlushCallback(void *p);
+    static void guideTimerCallback(void *p);
+    void cancelGuiding();
+    // GUIDE_DELIVERED gets what the axis' pulse actually sent, once no more of it will go out.
+    void publishGuideDelivered(int axis);
+
+    // Takes up a fit the pointing model has finished, if any.
+    void collectPointingModel();
+    // Hands the alignment the fitted terms, or none, as PointingModelSP says.
+    void applyPointingModel();
+    void clearPointingModel();
+
+    // Applies PublishRateNP to every publisher.
+    void updatePublishRate();
+    // Publishes AuxStatsNP and AuxLatencyNP from the bus counters, every STATS_INTERVAL_MS.
+    void publishStats(PollScheduler::Clock::time_point now);
+    // Starts or stops recording to the file in TraceFileTP, as TraceSP says.
+    bool updateTrace();
+    // RA encoder rate in steps/s for the selected tracking mode.
+    double trackingRate();
+
+    NumberPublisher m_encoderPublisher;
+    NumberPublisher m_pointingPublisher;
+    NumberPublisher m_guideRatePublisher;
+    NumberPublisher m_etaPublisher;
+
+    AUXBus m_bus;
+    AUXDispatcher m_dispatcher;
+    AUXTrace m_trace;
+    AUXStats::Totals m_statsTotals{};
+    uint64_t m_statsOverflows{0};
+    PollScheduler::Clock::time_point m_statsPublished;
+    int m_unsolicitedCallbackID{-1};
+
+    struct PendingPoll
+    {
+        AUXBus::Ticket ticket;
+        PollScheduler::Query query;
+        // m_gotoSequence when it was posted.
+        uint32_t gotoSequence;
+    };
+    PendingPoll m_polls[AUXBatch::CAPACITY];
+    size_t m_pollCount{0};
+    size_t m_pollsOutstanding{0};
+    bool m_pollCycle{false};
+    bool m_positionPolled{false};
+    bool m_slewPolled{false};
 
-    bool sendCmd(AUXCommand cmd);
-    bool readCmd(int timeout = 1);
-    bool handleCommand(AUXCommand cmd);
+    FixedEQAlignment<STEPS_PER_REVOLUTION> m_alignment;
+    PollScheduler m_pollScheduler;
+    EncoderPredictor m_predictor;
+    SlewPlanner m_slewPlanner;
+    SlewModel m_slewModel;
+    PointingModel m_pointingModel;
+    PointingTerms m_pointingTerms;
 
-    EQAlignment m_alignment;
+    struct GuideTimer
+    {
+        CelestronCGX *driver;
+        INDI_EQ_AXIS axis;
+        int id;
+        // A segment should go out with the next sendGuideSegments().
+        bool due;
+    };
+    GuidePulser m_pulsers[2];
+    GuideTimer m_guideTimers[2];
+    int m_guideFlushID{-1};
 };
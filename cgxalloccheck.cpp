@@ -0,0 +1,313 @@
+/*
+Checks that the driver's steady-state command path stays off the heap.
+
+    cgx_alloc_check [--cycles N]
+
+Runs an AUXBus against an AUXSimulator on the other end of a socketpair and goes through N poll
+cycles (10000 by default) the way ReadScopeStatus does: the polls are posted on the poll lane,
+notifyFD() is waited on, unsolicited frames go through an AUXDispatcher, and replies are collected
+and decoded. Every so often a goto is sent and waited on, and a guide pulse goes out on the urgent
+lane in the middle of a cycle, dropping the polls still queued.
+
+A counting operator new watches every thread but the simulator's, which stands in for the mount.
+After a short warm-up any allocation is a failure, as is a cycle that never finishes; either way
+the exit status is non-zero.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "auxbus.h"
+#include "auxdispatcher.h"
+#include "auxproto.h"
+#include "auxsimulator.h"
+
+static std::atomic<bool> s_counting{false};
+static std::atomic<uint64_t> s_allocations{0};
+// Set on the simulator's thread; the mount's allocations aren't the driver's.
+static thread_local bool t_uncounted = false;
+
+void *operator new(size_t size)
+{
+    if (s_counting.load(std::memory_order_relaxed) && !t_uncounted)
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static const int WARM_UP_CYCLES = 100;
+static const int GOTO_EVERY     = 500;
+static const int GUIDE_EVERY    = 50;
+// Runs the simulated motors fast, so gotos finish and announce themselves within the run.
+static const double SPEED = 100;
+// Far longer than any reply takes; a cycle still waiting after this has hung.
+static const int CYCLE_TIMEOUT_MS = 2000;
+
+struct Counts
+{
+    uint64_t replies{0};
+    uint64_t failed{0};
+    uint64_t unsolicited{0};
+    uint64_t slewsDone{0};
+    uint32_t positions[2]{0, 0};
+};
+
+static void serveMount(int fd, const std::atomic<bool> &stop)
+{
+    t_uncounted = true;
+
+    AUXSimulator mount;
+    Clock::time_point last = Clock::now();
+
+    while (!stop)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready         = poll(&pfd, 1, 1);
+
+        Clock::time_point now = Clock::now();
+        mount.advance(std::chrono::duration<double>(now - last).count() * SPEED);
+        last = now;
+
+        if (ready > 0 && (pfd.revents & POLLIN))
+        {
+            unsigned char bytes[256];
+            ssize_t n = read(fd, bytes, sizeof(bytes));
+            if (n <= 0)
+                return;
+
+            mount.receive(bytes, n);
+        }
+
+        buffer frame;
+        while (mount.nextFrame(frame))
+        {
+            if (write(fd, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size()))
+                return;
+        }
+    }
+}
+
+static void handleReply(const AUXCommand &reply, Counts &counts)
+{
+    uint32_t steps;
+    if (auxDecodePosition<MC_GET_POSITION>(reply, steps))
+        counts.positions[reply.src == DEC ? 1 : 0] = steps;
+
+    counts.replies++;
+}
+
+// Sends a short guide pulse on both axes and waits for the acknowledgements.
+static bool guide(AUXBus &bus)
+{
+    buffer data(2);
+    data[0] = 50;
+    data[1] = 1;
+
+    AUXBatch pulses;
+    pulses.push_back(AUXCommand(MC_AUX_GUIDE, ANY, RA, data));
+    pulses.push_back(AUXCommand(MC_AUX_GUIDE, ANY, DEC, data));
+
+    AUXBus::Ticket tickets[2];
+    bus.send(pulses, tickets, LANE_URGENT);
+
+    AUXCommand reply;
+    bool ok = bus.wait(tickets[0], reply);
+    return bus.wait(tickets[1], reply) && ok;
+}
+
+// Both axes a degree or so one way or the other, so the mount never stays still for long.
+static bool slew(AUXBus &bus, int cycle)
+{
+    uint32_t steps = (cycle / GOTO_EVERY % 2) * (AUXSimulator::STEPS_PER_REVOLUTION / 360);
+
+    AUXBatch gotos;
+    gotos.push_back(auxPositionCommand<MC_GOTO_FAST, RA>(steps));
+    gotos.push_back(auxPositionCommand<MC_GOTO_FAST, DEC>(steps));
+
+    AUXBus::Ticket tickets[2];
+    bus.send(gotos, tickets);
+
+    AUXCommand reply;
+    bool ok = bus.wait(tickets[0], reply);
+    return bus.wait(tickets[1], reply) && ok;
+}
+
+static bool pollCycle(AUXBus &bus, AUXDispatcher &dispatcher, int cycle, Counts &counts)
+{
+    AUXBatch polls;
+    polls.push_back(auxQuery<MC_GET_POSITION, DEC>());
+    polls.push_back(auxQuery<MC_GET_POSITION, RA>());
+    polls.push_back(auxQuery<MC_SLEW_DONE, RA>());
+    polls.push_back(auxQuery<MC_SLEW_DONE, DEC>());
+    polls.push_back(auxQuery<MC_GET_AUTOGUIDE_RATE, RA>());
+    polls.push_back(auxQuery<MC_GET_AUTOGUIDE_RATE, DEC>());
+
+    AUXBus::Ticket tickets[AUXBatch::CAPACITY];
+    size_t outstanding = 0;
+
+    for (size_t i = 0; i < polls.size(); i++)
+    {
+        tickets[i] = bus.post(polls[i], LANE_POLL);
+        if (tickets[i] != AUXBus::NO_TICKET)
+            outstanding++;
+    }
+
+    if (cycle % GUIDE_EVERY == 0 && !guide(bus))
+        counts.failed++;
+
+    while (outstanding > 0)
+    {
+        struct pollfd pfd = { bus.notifyFD(), POLLIN, 0 };
+        if (poll(&pfd, 1, CYCLE_TIMEOUT_MS) <= 0)
+            return false;
+
+        bus.clearNotify();
+
+        AUXCommand cmd;
+        while (bus.nextUnsolicited(cmd))
+            dispatcher.dispatch(cmd);
+
+        for (size_t i = 0; i < polls.size(); i++)
+        {
+            if (tickets[i] == AUXBus::NO_TICKET)
+                continue;
+
+            AUXCommand reply;
+            AUXBus::Result result = bus.collect(tickets[i], reply);
+            if (result == AUXBus::PENDING)
+                continue;
+
+            // Polls dropped for the guide pulse fail too; the next cycle asks again.
+            if (result == AUXBus::REPLIED)
+                handleReply(reply, counts);
+            else
+                counts.failed++;
+
+            tickets[i] = AUXBus::NO_TICKET;
+            outstanding--;
+        }
+    }
+
+    if (cycle % GOTO_EVERY == 0 && !slew(bus, cycle))
+        counts.failed++;
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int cycles = 10000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+        {
+            cycles = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--cycles N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        return 2;
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread mount(serveMount, fds[1], std::cref(stop));
+
+    Counts counts;
+
+    AUXDispatcher dispatcher;
+    dispatcher.subscribe(MC_SLEW_DONE, ANY, [&counts](const AUXCommand &) { counts.slewsDone++; });
+    dispatcher.setFallback([&counts](const AUXCommand &) { counts.unsolicited++; });
+
+    AUXBus bus;
+    if (!bus.start(fds[0]))
+    {
+        fprintf(stderr, "could not start the bus\n");
+        return 2;
+    }
+
+    bool hung = false;
+    int cycle = 0;
+
+    for (; cycle < WARM_UP_CYCLES + cycles; cycle++)
+    {
+        // Anything that only allocates the first time round has done so by now.
+        if (cycle == WARM_UP_CYCLES)
+        {
+            counts     = Counts();
+            s_counting = true;
+        }
+
+        if (!pollCycle(bus, dispatcher, cycle, counts))
+        {
+            hung = true;
+            break;
+        }
+    }
+
+    s_counting = false;
+
+    bus.stop();
+    stop = true;
+    mount.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("cycles %d, replies %llu, failed or skipped %llu, slews done %llu, other unsolicited "
+           "%llu\n",
+           cycle - WARM_UP_CYCLES, static_cast<unsigned long long>(counts.replies),
+           static_cast<unsigned long long>(counts.failed),
+           static_cast<unsigned long long>(counts.slewsDone),
+           static_cast<unsigned long long>(counts.unsolicited));
+    printf("allocations %llu\n", static_cast<unsigned long long>(s_allocations.load()));
+
+    if (hung)
+    {
+        fprintf(stderr, "FAIL: poll cycle %d never finished\n", cycle);
+        return 1;
+    }
+
+    if (s_allocations.load() != 0)
+    {
+        fprintf(stderr, "FAIL: the command path allocated\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,329 @@
+/*
+Microbenchmarks for the code that runs on every poll cycle: the AUX codec and the RA/Dec <->
+encoder conversions.
+
+    cgx_benchmark [--json] [--min-time SECONDS] [FILTER]
+
+Every benchmark runs for at least --min-time (0.2 s by default) and reports the time and heap
+allocations per operation. --json prints one JSON object per benchmark instead of the table, for
+comparing runs between releases. FILTER only runs benchmarks whose name contains it.
+*/
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "auxdecoder.h"
+#include "auxproto.h"
+#include "auxtrace.h"
+#include "fixedalignment.h"
+#include "simplealignment.h"
+#include "spscqueue.h"
+
+static uint64_t s_allocations = 0;
+
+void *operator new(size_t size)
+{
+    s_allocations++;
+
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+// Keeps the compiler from optimizing away a result nobody reads.
+template <typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+    bool json{false};
+    double minSeconds{0.2};
+    const char *filter{nullptr};
+};
+
+static Options s_options;
+
+/*
+Runs body(iterations) with growing iteration counts until it takes at least minSeconds, then
+reports the last run.
+*/
+template <typename Body>
+static void run(const char *name, Body body)
+{
+    if (s_options.filter != nullptr && strstr(name, s_options.filter) == nullptr)
+        return;
+
+    // Warm up caches and anything initialized on first use.
+    body(16);
+
+    uint64_t iterations = 1;
+    double seconds      = 0;
+    uint64_t allocations;
+
+    for (;;)
+    {
+        allocations = s_allocations;
+
+        Clock::time_point start = Clock::now();
+        body(iterations);
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        allocations = s_allocations - allocations;
+
+        if (seconds >= s_options.minSeconds || iterations >= (1ull << 40))
+            break;
+
+        // Aim a bit past the target so the final run usually clears it.
+        double scale = seconds > 0 ? 1.4 * s_options.minSeconds / seconds : 100;
+        iterations   = static_cast<uint64_t>(iterations * (scale < 100 ? scale : 100)) + 1;
+    }
+
+    double nsPerOp     = seconds * 1e9 / iterations;
+    double allocsPerOp = static_cast<double>(allocations) / iterations;
+
+    if (s_options.json)
+    {
+        printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f,\"allocs_per_op\":%.3f}\n",
+               name, static_cast<unsigned long long>(iterations), nsPerOp, allocsPerOp);
+    }
+    else
+    {
+        printf("%-40s %12llu %12.2f ns/op %8.2f allocs/op\n", name,
+               static_cast<unsigned long long>(iterations), nsPerOp, allocsPerOp);
+    }
+}
+
+static void codecBenchmarks()
+{
+    AUXCommand position = auxPositionCommand<MC_GOTO_FAST, RA>(0x123456);
+
+    buffer frame;
+    position.fillBuf(frame);
+
+    run("AUXCommand::fillBuf", [&](uint64_t n) {
+        buffer out;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            position.fillBuf(out);
+            keep(out);
+        }
+    });
+
+    run("AUXCommand::parseBuf", [&](uint64_t n) {
+        AUXCommand cmd;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            cmd.parseBuf(frame);
+            keep(cmd);
+        }
+    });
+
+    run("AUXCommand::checksum", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+        {
+            unsigned char sum = AUXCommand::checksum(frame);
+            keep(sum);
+        }
+    });
+
+    run("AUXCommand::getPosition", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+        {
+            long steps = position.getPosition();
+            keep(steps);
+        }
+    });
+
+    run("AUXCommand::setPosition", [&](uint64_t n) {
+        AUXCommand cmd(MC_GOTO_FAST, ANY, RA);
+        for (uint64_t i = 0; i < n; i++)
+        {
+            cmd.setPosition(static_cast<uint32_t>(i));
+            keep(cmd);
+        }
+    });
+
+    run("AUXFrameDecoder::feed+next", [&](uint64_t n) {
+        AUXFrameDecoder decoder;
+        AUXCommand cmd;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            decoder.feed(frame.data(), frame.size());
+            decoder.next(cmd);
+            keep(cmd);
+        }
+    });
+
+    // One thread, so this is the cost of the queue itself without cache lines moving between cores.
+    run("SPSCQueue::push+pop", [&](uint64_t n) {
+        static SPSCQueue<AUXCommand, 64> queue;
+        AUXCommand in(frame), out;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            queue.push(in);
+            queue.pop(out);
+            keep(out);
+        }
+    });
+
+    static const char *TRACE_FILE = "/tmp/cgx_benchmark.trace";
+
+    AUXTrace trace;
+    if (trace.open(TRACE_FILE, 4096))
+    {
+        Clock::time_point now = Clock::now();
+
+        run("AUXTrace::record[off]", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                trace.record(AUXTrace::TO_MOUNT, now, frame.data(), frame.size());
+        });
+
+        trace.start();
+        run("AUXTrace::record", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                trace.record(AUXTrace::TO_MOUNT, now, frame.data(), frame.size());
+        });
+
+        trace.close();
+        unlink(TRACE_FILE);
+    }
+}
+
+// Spread of targets so branches on pier side and hour angle don't always go the same way.
+static const size_t POINTS = 1024;
+
+template <typename Alignment>
+static void alignmentBenchmarks(const char *prefix, Alignment &alignment)
+{
+    static double ra[POINTS], dec[POINTS];
+    static uint32_t raSteps[POINTS], decSteps[POINTS];
+    static EQAlignment::TelescopePierSide pierSide[POINTS];
+
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        ra[i]  = 24.0 * i / POINTS;
+        dec[i] = -80.0 + 170.0 * ((i * 7) % POINTS) / POINTS;
+    }
+
+    alignment.UpdateLongitude(-97.0);
+    double lst = alignment.localSiderealTime();
+    alignment.EncoderValuesFromRADec(lst, POINTS, ra, dec, raSteps, decSteps, pierSide);
+
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s::EncoderValuesFromRADec", prefix);
+    run(name, [&](uint64_t n) {
+        uint32_t r, d;
+        EQAlignment::TelescopePierSide side;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            alignment.EncoderValuesFromRADec(ra[i % POINTS], dec[i % POINTS], r, d, side);
+            keep(r);
+            keep(d);
+        }
+    });
+
+    snprintf(name, sizeof(name), "%s::RADecFromEncoderValues", prefix);
+    run(name, [&](uint64_t n) {
+        double r, d;
+        EQAlignment::TelescopePierSide side;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            alignment.UpdateSteps(raSteps[i % POINTS], decSteps[i % POINTS]);
+            alignment.RADecFromEncoderValues(r, d, side);
+            keep(r);
+            keep(d);
+        }
+    });
+
+    snprintf(name, sizeof(name), "%s::localSiderealTime", prefix);
+    run(name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+        {
+            double t = alignment.localSiderealTime();
+            keep(t);
+        }
+    });
+
+    // Reported per point, so it compares directly with the single conversions above.
+    snprintf(name, sizeof(name), "%s::EncoderValuesFromRADec[batch]", prefix);
+    run(name, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i += POINTS)
+        {
+            size_t count = n - i < POINTS ? n - i : POINTS;
+            alignment.EncoderValuesFromRADec(lst, count, ra, dec, raSteps, decSteps, pierSide);
+            keep(raSteps);
+        }
+    });
+
+    snprintf(name, sizeof(name), "%s::RADecFromEncoderValues[batch]", prefix);
+    run(name, [&](uint64_t n) {
+        static double outRa[POINTS], outDec[POINTS];
+        for (uint64_t i = 0; i < n; i += POINTS)
+        {
+            size_t count = n - i < POINTS ? n - i : POINTS;
+            alignment.RADecFromEncoderValues(lst, count, raSteps, decSteps, outRa, outDec,
+                                             pierSide);
+            keep(outRa);
+        }
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            s_options.json = true;
+        }
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+        {
+            s_options.minSeconds = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [--json] [--min-time SECONDS] [FILTER]\n", argv[0]);
+            return 1;
+        }
+        else
+        {
+            s_options.filter = argv[i];
+        }
+    }
+
+    codecBenchmarks();
+
+    EQAlignment alignment(0x1000000);
+    alignmentBenchmarks("EQAlignment", alignment);
+
+    FixedEQAlignment<0x1000000> fixedAlignment;
+    alignmentBenchmarks("FixedEQAlignment", fixedAlignment);
+
+    return 0;
+}
@@ -0,0 +1,397 @@
+/*
+Measures the driver's end to end latency against the simulated mount.
+
+    cgx_latency [--driver PATH] [--samples N] [--pulse-ms N] [--speed X] [--poll-ms N]
+                [--byte-us N] [--reply-us N] [--json] [--verbose]
+
+The driver runs as a child process and is driven over INDI XML on its stdin and stdout, the way
+indiserver would, with an AUXSimulator on a pseudo-terminal as its serial port. After homing the
+mount it times:
+
+goto        EQUATORIAL_EOD_COORD sent -> first motion command on the wire
+slew_done   the later axis' SLEW_DONE on the wire -> EQUATORIAL_EOD_COORD back to Ok
+guide       TELESCOPE_TIMED_GUIDE_NS sent -> MC_AUX_GUIDE on the wire
+guide_done  the motor finishing the pulse -> TELESCOPE_TIMED_GUIDE_NS back to Idle
+abort       TELESCOPE_ABORT_MOTION sent -> both motors told to stop
+
+and prints percentiles for each. The driver keeps polling the mount the whole time. --poll-ms
+changes its polling period, and --byte-us and --reply-us slow the link down, to see how latency
+holds up under load. --speed runs the simulated motors faster than real time so slews take less
+of the run; it doesn't change any of the latencies above.
+*/
+
+#include <algorithm>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "auxsimulator.h"
+#include "driverharness.h"
+
+struct Options : HarnessOptions
+{
+    int samples{20};
+    int pulseMs{200};
+    int pollMs{0};
+    bool json{false};
+};
+
+struct Metric
+{
+    const char *name;
+    std::vector<double> ms;
+};
+
+// Nearest rank percentile of sorted samples.
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(ceil(p / 100 * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void report(const std::vector<Metric> &metrics, bool json)
+{
+    if (!json)
+    {
+        printf("%-12s %6s %9s %9s %9s %9s %9s  (ms)\n", "", "n", "min", "p50", "p90", "p99",
+               "max");
+    }
+
+    for (size_t i = 0; i < metrics.size(); i++)
+    {
+        std::vector<double> sorted = metrics[i].ms;
+        std::sort(sorted.begin(), sorted.end());
+
+        if (sorted.empty())
+        {
+            if (json)
+                printf("{\"name\":\"%s\",\"samples\":0}\n", metrics[i].name);
+            else
+                printf("%-12s %6d\n", metrics[i].name, 0);
+            continue;
+        }
+
+        double p50 = percentile(sorted, 50), p90 = percentile(sorted, 90),
+               p99 = percentile(sorted, 99);
+
+        if (json)
+        {
+            printf("{\"name\":\"%s\",\"samples\":%zu,\"min_ms\":%.3f,\"p50_ms\":%.3f,"
+                   "\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+                   metrics[i].name, sorted.size(), sorted.front(), p50, p90, p99, sorted.back());
+        }
+        else
+        {
+            printf("%-12s %6zu %9.2f %9.2f %9.2f %9.2f %9.2f\n", metrics[i].name, sorted.size(),
+                   sorted.front(), p50, p90, p99, sorted.back());
+        }
+    }
+}
+
+static bool isMotion(const AUXCommand &cmd)
+{
+    return cmd.cmd == MC_GOTO_FAST || cmd.cmd == MC_GOTO_SLOW || cmd.cmd == MC_LEVEL_START;
+}
+
+static bool isStop(const AUXCommand &cmd)
+{
+    return (cmd.cmd == MC_MOVE_POS || cmd.cmd == MC_MOVE_NEG) && cmd.data.size() == 1 &&
+           cmd.data[0] == 0;
+}
+
+static double wrapHours(double hours)
+{
+    hours = fmod(hours, 24.0);
+    return hours < 0 ? hours + 24.0 : hours;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--driver PATH] [--samples N] [--pulse-ms N] [--speed X] [--poll-ms N]\n"
+            "       [--byte-us N] [--reply-us N] [--json] [--verbose]\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options)
+{
+    static const struct option longOptions[] = {
+        { "driver", required_argument, nullptr, 'd' },
+        { "samples", required_argument, nullptr, 'n' },
+        { "pulse-ms", required_argument, nullptr, 'p' },
+        { "speed", required_argument, nullptr, 's' },
+        { "poll-ms", required_argument, nullptr, 'P' },
+        { "byte-us", required_argument, nullptr, 'b' },
+        { "reply-us", required_argument, nullptr, 'r' },
+        { "json", no_argument, nullptr, 'j' },
+        { "verbose", no_argument, nullptr, 'v' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:n:p:s:P:b:r:jv", longOptions, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            options.driver = optarg;
+            break;
+        case 'n':
+            options.samples = std::max(1, atoi(optarg));
+            break;
+        case 'p':
+            options.pulseMs = std::min(std::max(10, atoi(optarg)), 2550);
+            break;
+        case 's':
+            options.speed = std::max(0.1, atof(optarg));
+            break;
+        case 'P':
+            options.pollMs = atoi(optarg);
+            break;
+        case 'b':
+            options.byteUs = atoi(optarg);
+            break;
+        case 'r':
+            options.replyUs = atoi(optarg);
+            break;
+        case 'j':
+            options.json = true;
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Connects the driver to the simulator and homes the mount. Returns the RA home points at.
+static bool setUp(DriverHarness &harness, const Options &options, double &homeRA)
+{
+    if (!harness.connect())
+        return false;
+
+    if (options.pollMs > 0)
+        harness.newNumber("POLLING_PERIOD", { { "PERIOD_MS", options.pollMs } });
+
+    // Whatever park state the driver loaded from its config would block gotos.
+    harness.newSwitch("TELESCOPE_PARK", "UNPARK");
+
+    fprintf(stderr, "homing\n");
+
+    PropertyUpdate update;
+    Clock::time_point since = Clock::now();
+    harness.newSwitch("ALIGN", "ALIGN");
+
+    if (!harness.waitForProperty(since, "ALIGN", "Ok", 300 / options.speed + 10, update))
+    {
+        fprintf(stderr, "homing didn't finish\n");
+        return false;
+    }
+
+    // Give the driver a poll or two to report where home is.
+    since = Clock::now();
+    harness.pumpFor(1.0);
+
+    if (!harness.waitForProperty(since, "EQUATORIAL_EOD_COORD", nullptr, 5, update) ||
+        std::isnan(update.number("RA")))
+    {
+        fprintf(stderr, "driver didn't report its position\n");
+        return false;
+    }
+
+    homeRA = update.number("RA");
+    return true;
+}
+
+// Short gotos either side of home, so none of them needs a meridian flip.
+static void measureGotos(DriverHarness &harness, const Options &options, double homeRA,
+                         Metric &gotoMs, Metric &slewDoneMs)
+{
+    for (int i = 0; i < options.samples; i++)
+    {
+        fprintf(stderr, "goto %d/%d\n", i + 1, options.samples);
+
+        double ra  = wrapHours(homeRA + (i % 2 == 0 ? 0.5 : -0.5));
+        double dec = i % 2 == 0 ? 60 : 50;
+
+        Clock::time_point sent = Clock::now();
+        harness.newNumber("EQUATORIAL_EOD_COORD", { { "RA", ra }, { "DEC", dec } });
+
+        WireFrame motion;
+        if (!harness.waitForRequest(sent, isMotion, 5, motion))
+        {
+            fprintf(stderr, "no goto on the wire\n");
+            continue;
+        }
+        gotoMs.ms.push_back(millisecondsBetween(sent, motion.time));
+
+        PropertyUpdate update;
+        if (motion.cmd.cmd == MC_LEVEL_START)
+        {
+            // The driver went home first; that slew isn't comparable, so just let it finish.
+            harness.waitForProperty(sent, "EQUATORIAL_EOD_COORD", "Ok", 600 / options.speed,
+                                    update);
+            continue;
+        }
+
+        // Each axis announces the end of its goto; the later one ends the slew.
+        const WireFrame *done = nullptr;
+        auto announced        = [](const WireFrame &f) {
+            return f.cmd.cmd == MC_SLEW_DONE && f.cmd.data.empty();
+        };
+        harness.pumpUntil(
+            [&]() {
+                done = findAfter(harness.replies, sent, announced, 1);
+                return done != nullptr;
+            },
+            120 / options.speed + 5);
+
+        if (done == nullptr)
+        {
+            fprintf(stderr, "slew didn't finish\n");
+            continue;
+        }
+
+        Clock::time_point doneTime = done->time;
+        if (!harness.waitForProperty(doneTime, "EQUATORIAL_EOD_COORD", "Ok", 5, update))
+        {
+            fprintf(stderr, "driver didn't notice the slew finishing\n");
+            continue;
+        }
+        slewDoneMs.ms.push_back(millisecondsBetween(doneTime, update.time));
+    }
+}
+
+// Alternating north and south pulses while tracking.
+static void measureGuiding(DriverHarness &harness, const Options &options, Metric &guideMs,
+                           Metric &guideDoneMs)
+{
+    for (int i = 0; i < options.samples; i++)
+    {
+        fprintf(stderr, "guide %d/%d\n", i + 1, options.samples);
+
+        bool north = i % 2 == 0;
+
+        Clock::time_point sent = Clock::now();
+        harness.newNumber("TELESCOPE_TIMED_GUIDE_NS",
+                          { { "TIMED_GUIDE_N", north ? options.pulseMs : 0 },
+                            { "TIMED_GUIDE_S", north ? 0 : options.pulseMs } });
+
+        auto isPulse = [](const AUXCommand &cmd) {
+            return cmd.cmd == MC_AUX_GUIDE && cmd.dst == DEC;
+        };
+
+        WireFrame pulse;
+        if (!harness.waitForRequest(sent, isPulse, 5, pulse))
+        {
+            fprintf(stderr, "no guide pulse on the wire\n");
+            continue;
+        }
+        guideMs.ms.push_back(millisecondsBetween(sent, pulse.time));
+
+        // The motor times the pulse in 10 ms ticks, in simulated time.
+        Clock::time_point end =
+            pulse.time + std::chrono::microseconds(static_cast<int64_t>(
+                             pulse.cmd.data[1] * 10000 / options.speed));
+
+        PropertyUpdate update;
+        if (!harness.waitForProperty(pulse.time, "TELESCOPE_TIMED_GUIDE_NS", "Idle",
+                                     options.pulseMs / 1000.0 + 5, update))
+        {
+            fprintf(stderr, "guide pulse never completed\n");
+            continue;
+        }
+        guideDoneMs.ms.push_back(millisecondsBetween(end, update.time));
+
+        harness.pumpFor(0.1);
+    }
+}
+
+// Aborts long gotos shortly after they start.
+static void measureAborts(DriverHarness &harness, const Options &options, double homeRA,
+                          Metric &abortMs)
+{
+    for (int i = 0; i < options.samples; i++)
+    {
+        fprintf(stderr, "abort %d/%d\n", i + 1, options.samples);
+
+        double ra = wrapHours(homeRA + (i % 2 == 0 ? 2 : -2));
+
+        Clock::time_point sent = Clock::now();
+        harness.newNumber("EQUATORIAL_EOD_COORD", { { "RA", ra }, { "DEC", 20 } });
+
+        WireFrame frame;
+        if (!harness.waitForRequest(sent, isMotion, 5, frame))
+        {
+            fprintf(stderr, "no goto on the wire\n");
+            continue;
+        }
+
+        harness.pumpFor(0.3);
+
+        sent = Clock::now();
+        harness.newSwitch("TELESCOPE_ABORT_MOTION", "ABORT");
+
+        // The driver stops both axes; the later of the two is when the mount is stopped.
+        const WireFrame *stop = nullptr;
+        harness.pumpUntil(
+            [&]() {
+                stop = findAfter(harness.requests, sent,
+                                 [](const WireFrame &f) { return isStop(f.cmd); }, 1);
+                return stop != nullptr;
+            },
+            5);
+
+        if (stop == nullptr)
+        {
+            fprintf(stderr, "no stop on the wire\n");
+            continue;
+        }
+        abortMs.ms.push_back(millisecondsBetween(sent, stop->time));
+
+        harness.pumpFor(0.3);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    AUXSimulator sim;
+    DriverHarness harness(sim, options);
+    if (!harness.start())
+        return 1;
+
+    double homeRA = 0;
+    if (!setUp(harness, options, homeRA))
+    {
+        harness.stop();
+        return 1;
+    }
+
+    std::vector<Metric> metrics = { { "goto", {} },  { "slew_done", {} }, { "guide", {} },
+                                    { "guide_done", {} }, { "abort", {} } };
+
+    measureGotos(harness, options, homeRA, metrics[0], metrics[1]);
+    measureGuiding(harness, options, metrics[2], metrics[3]);
+    measureAborts(harness, options, homeRA, metrics[4]);
+
+    harness.stop();
+
+    report(metrics, options.json);
+    return 0;
+}
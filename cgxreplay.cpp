@@ -0,0 +1,469 @@
+/*
+Plays back a trace recorded with the driver's AUX_TRACE switch.
+
+    cgx_replay [--dump] [--passes N] TRACE
+    cgx_replay --driver PATH [--runs N] [--speed X] [--commands FILE] [--verbose] TRACE
+
+On its own it decodes the trace, prints what's in it, and times the decoder over the whole of it,
+--passes times over. --dump also prints every frame.
+
+With --driver it runs the driver against the trace --runs times (2 by default), with an AUXReplay
+standing in for the mount, and compares what the driver did. Each run lasts as long as the trace
+did, divided by --speed. The comparison is of every property's sequence of states and, for switch
+vectors, of which switches were on; values that depend on when a poll happened to land, like the
+coordinates, are left out. Runs that differ are reported and the exit status is 1.
+
+The trace only has the driver's side of the conversation with the mount, not what clients asked
+the driver to do. --commands replays those from a file with a line per command:
+
+    SECONDS PROPERTY ELEMENT[=VALUE] ...
+
+sent that many seconds into the run, in trace time. Elements with values make a number vector and
+those without turn switches on. Lines starting with # are ignored. For example:
+
+    12.5 TELESCOPE_PARK UNPARK
+    14 EQUATORIAL_EOD_COORD RA=5.5 DEC=22
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <map>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "auxdecoder.h"
+#include "auxreplay.h"
+#include "auxtrace.h"
+#include "driverharness.h"
+
+struct Options : HarnessOptions
+{
+    bool dump{false};
+    int passes{5};
+    int runs{0};
+    const char *commands{nullptr};
+    const char *trace{nullptr};
+};
+
+struct Command
+{
+    double seconds;
+    std::string property;
+    NumberValues numbers;
+    std::vector<std::string> switches;
+};
+
+// Each property's states, in order, with repeats dropped.
+typedef std::map<std::string, std::vector<std::string>> Transitions;
+
+// Properties that change with the timing of the run rather than with what the mount said.
+static const char *const TIMING_PROPERTIES[] = { "AUX_STATS", "AUX_LATENCY", "TIME_UTC",
+                                                 "POLLING_PERIOD" };
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--dump] [--passes N] TRACE\n"
+            "       %s --driver PATH [--runs N] [--speed X] [--commands FILE] [--verbose] TRACE\n",
+            argv0, argv0);
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options)
+{
+    static const struct option longOptions[] = {
+        { "dump", no_argument, nullptr, 'D' },
+        { "passes", required_argument, nullptr, 'p' },
+        { "driver", required_argument, nullptr, 'd' },
+        { "runs", required_argument, nullptr, 'n' },
+        { "speed", required_argument, nullptr, 's' },
+        { "commands", required_argument, nullptr, 'c' },
+        { "verbose", no_argument, nullptr, 'v' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "Dp:d:n:s:c:v", longOptions, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'D':
+            options.dump = true;
+            break;
+        case 'p':
+            options.passes = std::max(1, atoi(optarg));
+            break;
+        case 'd':
+            options.driver = optarg;
+            if (options.runs == 0)
+                options.runs = 2;
+            break;
+        case 'n':
+            options.runs = std::max(1, atoi(optarg));
+            break;
+        case 's':
+            options.speed = std::max(0.1, atof(optarg));
+            break;
+        case 'c':
+            options.commands = optarg;
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (optind != argc - 1)
+        return false;
+
+    options.trace = argv[optind];
+    return true;
+}
+
+static void printFrame(const AUXReplay::Frame &frame)
+{
+    const AUXCommand &cmd = frame.cmd;
+    const char *name      = cmd.cmd_name(cmd.cmd);
+    const char *src       = AUXCommand::node_name(cmd.src);
+    const char *dst       = AUXCommand::node_name(cmd.dst);
+
+    printf("%12.6f %s %-4s -> %-4s ", frame.offsetNs / 1e9,
+           frame.direction == AUXTrace::TO_MOUNT ? "tx" : "rx", src != nullptr ? src : "?",
+           dst != nullptr ? dst : "?");
+
+    if (name != nullptr)
+        printf("%-22s", name);
+    else
+        printf("0x%02x%18s", cmd.cmd & 0xff, "");
+
+    for (size_t i = 0; i < cmd.data.size(); i++)
+        printf(" %02x", cmd.data[i]);
+    printf("\n");
+}
+
+static void summarize(const AUXReplay &replay)
+{
+    const AUXReplay::Counts &counts = replay.counts();
+
+    printf("%zu frames over %.1f s\n", replay.frames().size(), replay.duration());
+    printf("  requests     %u\n", counts.recordedRequests);
+    printf("  replies      %u\n", counts.recordedReplies);
+    printf("  unsolicited  %u\n", counts.recordedUnsolicited);
+    printf("  bad checksum %u\n", counts.checksumErrors);
+    printf("  resyncs      %u\n", counts.resyncs);
+    if (counts.dropped > 0)
+        printf("  overwritten while reading %llu\n",
+               static_cast<unsigned long long>(counts.dropped));
+}
+
+// Decodes the records over and over, as the bus's I/O thread would, without the file in the way.
+static void benchmark(AUXTraceReader &reader, int passes)
+{
+    std::vector<AUXTraceReader::Entry> entries;
+    AUXTraceReader::Entry entry;
+
+    reader.rewind();
+    while (reader.next(entry))
+        entries.push_back(entry);
+
+    uint64_t bytes = 0, frames = 0;
+    Clock::time_point start = Clock::now();
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+        AUXFrameDecoder decoders[2];
+        AUXCommand cmd;
+
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            AUXFrameDecoder &decoder = decoders[entries[i].direction & 1];
+            const unsigned char *data = entries[i].bytes;
+            size_t left               = entries[i].length;
+
+            bytes += left;
+            while (left > 0)
+            {
+                size_t accepted = decoder.feed(data, left);
+                data += accepted;
+                left -= accepted;
+
+                while (decoder.next(cmd))
+                    frames++;
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (frames == 0 || seconds <= 0)
+        return;
+
+    printf("decoded %llu frames in %.3f s: %.1f ns/frame, %.1f MB/s\n",
+           static_cast<unsigned long long>(frames), seconds, seconds * 1e9 / frames,
+           bytes / seconds / 1e6);
+}
+
+static bool loadCommands(const char *path, std::vector<Command> &commands)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[1024];
+    int number = 0;
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        number++;
+
+        char *save  = nullptr;
+        char *token = strtok_r(line, " \t\r\n", &save);
+        if (token == nullptr || token[0] == '#')
+            continue;
+
+        Command command;
+        command.seconds = atof(token);
+
+        token = strtok_r(nullptr, " \t\r\n", &save);
+        if (token == nullptr)
+        {
+            fprintf(stderr, "%s:%d: no property\n", path, number);
+            fclose(file);
+            return false;
+        }
+        command.property = token;
+
+        while ((token = strtok_r(nullptr, " \t\r\n", &save)) != nullptr)
+        {
+            char *equals = strchr(token, '=');
+            if (equals == nullptr)
+            {
+                command.switches.push_back(token);
+                continue;
+            }
+
+            *equals = '\0';
+            command.numbers.push_back(std::make_pair(std::string(token), atof(equals + 1)));
+        }
+
+        commands.push_back(command);
+    }
+
+    fclose(file);
+
+    std::stable_sort(commands.begin(), commands.end(), [](const Command &a, const Command &b) {
+        return a.seconds < b.seconds;
+    });
+    return true;
+}
+
+static bool timingProperty(const std::string &name)
+{
+    for (size_t i = 0; i < sizeof(TIMING_PROPERTIES) / sizeof(TIMING_PROPERTIES[0]); i++)
+    {
+        if (name == TIMING_PROPERTIES[i])
+            return true;
+    }
+    return false;
+}
+
+static Transitions transitions(const std::vector<PropertyUpdate> &updates)
+{
+    Transitions result;
+
+    for (size_t i = 0; i < updates.size(); i++)
+    {
+        const PropertyUpdate &update = updates[i];
+        if (update.tag.compare(0, 3, "set") != 0 || timingProperty(update.name))
+            continue;
+
+        std::string state = update.state;
+        for (size_t s = 0; s < update.switchesOn.size(); s++)
+            state += (s == 0 ? " " : ",") + update.switchesOn[s];
+
+        std::vector<std::string> &states = result[update.name];
+        if (states.empty() || states.back() != state)
+            states.push_back(state);
+    }
+
+    return result;
+}
+
+static void sendCommand(DriverHarness &harness, const Command &command)
+{
+    if (!command.numbers.empty())
+        harness.newNumber(command.property.c_str(), command.numbers);
+
+    for (size_t i = 0; i < command.switches.size(); i++)
+        harness.newSwitch(command.property.c_str(), command.switches[i].c_str());
+}
+
+static bool runDriver(const Options &options, AUXReplay &replay,
+                      const std::vector<Command> &commands, Transitions &result)
+{
+    replay.restart();
+
+    // The mount starts playing when the harness starts, and commands are timed from then too.
+    Clock::time_point start = Clock::now();
+
+    DriverHarness harness(replay, options);
+    if (!harness.start())
+        return false;
+
+    if (!harness.connect())
+    {
+        harness.stop();
+        return false;
+    }
+
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        Clock::time_point due =
+            start + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(commands[i].seconds / options.speed));
+
+        harness.pumpFor(std::max(0.0, std::chrono::duration<double>(due - Clock::now()).count()));
+        sendCommand(harness, commands[i]);
+    }
+
+    double left = replay.duration() / options.speed -
+                  std::chrono::duration<double>(Clock::now() - start).count();
+    harness.pumpUntil([&]() { return replay.finished(); }, std::max(0.0, left) + 1);
+
+    // Let the driver act on the last of it.
+    harness.pumpFor(2);
+    harness.stop();
+
+    const AUXReplay::Counts &counts = replay.counts();
+    fprintf(stderr,
+            "  %u requests: %u replayed, %u repeated, %u unanswered; %u of %u unsolicited sent\n",
+            counts.requests, counts.replayed, counts.repeated, counts.unanswered,
+            counts.unsolicited, counts.recordedUnsolicited);
+
+    result = transitions(harness.properties);
+    return true;
+}
+
+static void printStates(const char *label, const std::vector<std::string> &states)
+{
+    printf("    %s:", label);
+    for (size_t i = 0; i < states.size(); i++)
+        printf(" [%s]", states[i].c_str());
+    printf("\n");
+}
+
+// Returns whether `run` did the same as `first`.
+static bool compare(const Transitions &first, const Transitions &run, int index)
+{
+    Transitions all = first;
+    all.insert(run.begin(), run.end());
+
+    static const std::vector<std::string> none;
+    bool same = true;
+
+    for (Transitions::const_iterator it = all.begin(); it != all.end(); ++it)
+    {
+        Transitions::const_iterator a = first.find(it->first);
+        Transitions::const_iterator b = run.find(it->first);
+        const std::vector<std::string> &expected = a != first.end() ? a->second : none;
+        const std::vector<std::string> &actual   = b != run.end() ? b->second : none;
+
+        if (expected == actual)
+            continue;
+
+        if (same)
+            printf("run %d differs from run 1:\n", index + 1);
+        same = false;
+
+        char label[32];
+        snprintf(label, sizeof(label), "run %d", index + 1);
+
+        printf("  %s\n", it->first.c_str());
+        printStates("run 1", expected);
+        printStates(label, actual);
+    }
+
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    AUXTraceReader reader;
+    if (!reader.open(options.trace))
+    {
+        fprintf(stderr, "%s: not a trace file\n", options.trace);
+        return 1;
+    }
+
+    AUXReplay replay;
+    Clock::time_point loadStart = Clock::now();
+    if (!replay.load(reader))
+    {
+        fprintf(stderr, "%s: no frames in the trace\n", options.trace);
+        return 1;
+    }
+    double loadMs = millisecondsBetween(loadStart, Clock::now());
+
+    if (options.dump)
+    {
+        for (size_t i = 0; i < replay.frames().size(); i++)
+            printFrame(replay.frames()[i]);
+    }
+
+    if (options.runs == 0)
+    {
+        summarize(replay);
+        printf("loaded in %.1f ms\n", loadMs);
+        benchmark(reader, options.passes);
+        return 0;
+    }
+
+    std::vector<Command> commands;
+    if (options.commands != nullptr && !loadCommands(options.commands, commands))
+        return 1;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Transitions> runs;
+    for (int i = 0; i < options.runs; i++)
+    {
+        fprintf(stderr, "run %d/%d, %.1f s\n", i + 1, options.runs,
+                replay.duration() / options.speed);
+
+        Transitions result;
+        if (!runDriver(options, replay, commands, result))
+            return 1;
+        runs.push_back(result);
+    }
+
+    bool same = true;
+    for (size_t i = 1; i < runs.size(); i++)
+        same = compare(runs[0], runs[i], static_cast<int>(i)) && same;
+
+    if (options.verbose || runs.size() == 1)
+    {
+        printf("transitions:\n");
+        for (Transitions::const_iterator it = runs[0].begin(); it != runs[0].end(); ++it)
+            printStates(it->first.c_str(), it->second);
+    }
+
+    if (same && runs.size() > 1)
+        printf("%zu runs, all the same\n", runs.size());
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+Runs AUXSimulator behind a pseudo-terminal, so the driver can be pointed at the pty's slave device
+like at the mount's USB serial port.
+
+    cgx_simulator [--link PATH] [--replay TRACE] [--speed X] [--byte-us N] [--reply-us N]
+                  [--verbose]
+
+--link      also make PATH a symlink to the slave device, e.g. /tmp/cgx
+--replay    play back a trace recorded with AUX_TRACE instead of simulating (see AUXReplay)
+--speed     run the mount's clock this many times faster than real time
+--byte-us   delay after every byte sent back, to model a slow link (87 is 115200 baud)
+--reply-us  delay between a request arriving and its reply going out
+--verbose   print every frame in both directions to stderr
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "auxreplay.h"
+#include "auxsimulator.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void onSignal(int)
+{
+    s_stop = 1;
+}
+
+static bool writeAll(int fd, const unsigned char *data, size_t n, int byteUs)
+{
+    // With a per byte delay, trickle the frame out the way a slow UART would.
+    size_t chunk = byteUs > 0 ? 1 : n;
+
+    while (n > 0)
+    {
+        ssize_t written = write(fd, data, std::min(chunk, n));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                return false;
+
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            poll(&pfd, 1, 100);
+            continue;
+        }
+
+        data += written;
+        n -= written;
+
+        if (byteUs > 0)
+            usleep(byteUs);
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *link   = nullptr;
+    const char *replay = nullptr;
+    double speed       = 1;
+    int byteUs         = 0;
+    int replyUs        = 0;
+    bool verbose       = false;
+
+    static const struct option options[] = {
+        { "link", required_argument, nullptr, 'l' },
+        { "replay", required_argument, nullptr, 'R' },
+        { "speed", required_argument, nullptr, 's' },
+        { "byte-us", required_argument, nullptr, 'b' },
+        { "reply-us", required_argument, nullptr, 'r' },
+        { "verbose", no_argument, nullptr, 'v' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:R:s:b:r:v", options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            link = optarg;
+            break;
+        case 'R':
+            replay = optarg;
+            break;
+        case 's':
+            speed = std::max(0.1, atof(optarg));
+            break;
+        case 'b':
+            byteUs = atoi(optarg);
+            break;
+        case 'r':
+            replyUs = atoi(optarg);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [--link PATH] [--replay TRACE] [--speed X] [--byte-us N]\n"
+                    "       [--reply-us N] [--verbose]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    AUXSimulator sim;
+    AUXReplay player;
+    AUXMount *mount = &sim;
+
+    if (replay != nullptr)
+    {
+        if (!player.load(replay))
+        {
+            fprintf(stderr, "%s: not a trace, or nothing in it\n", replay);
+            return 1;
+        }
+        mount = &player;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    const char *slaveName = ptsname(master);
+
+    // Keep the slave open ourselves: a pty whose slave side is closed hands the master EIO, which
+    // would end the simulator every time the driver disconnects.
+    int slave = open(slaveName, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    {
+        perror(slaveName);
+        return 1;
+    }
+
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if (link != nullptr)
+    {
+        unlink(link);
+        if (symlink(slaveName, link) != 0)
+        {
+            perror(link);
+            return 1;
+        }
+    }
+
+    printf("%s\n", link != nullptr ? link : slaveName);
+    fflush(stdout);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    Clock::time_point last = Clock::now();
+
+    while (!s_stop)
+    {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        int ready         = poll(&pfd, 1, 10);
+
+        Clock::time_point now = Clock::now();
+        mount->advance(std::chrono::duration<double>(now - last).count() * speed);
+        last = now;
+
+        if (ready > 0 && (pfd.revents & POLLIN))
+        {
+            unsigned char bytes[256];
+            ssize_t n = read(master, bytes, sizeof(bytes));
+
+            if (n > 0)
+            {
+                if (verbose)
+                {
+                    fprintf(stderr, "<- ");
+                    prnBytes(bytes, n);
+                }
+
+                mount->receive(bytes, n);
+
+                if (replyUs > 0)
+                    usleep(replyUs);
+            }
+        }
+
+        buffer frame;
+        while (mount->nextFrame(frame))
+        {
+            if (verbose)
+            {
+                fprintf(stderr, "-> ");
+                prnBytes(frame.data(), frame.size());
+            }
+
+            if (!writeAll(master, frame.data(), frame.size(), byteUs))
+            {
+                perror("write");
+                s_stop = 1;
+                break;
+            }
+        }
+    }
+
+    if (link != nullptr)
+        unlink(link);
+
+    close(slave);
+    close(master);
+
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include "driverharness.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+double PropertyUpdate::number(const char *element) const
+{
+    for (size_t i = 0; i < numbers.size(); i++)
+    {
+        if (numbers[i].first == element)
+            return numbers[i].second;
+    }
+    return NAN;
+}
+
+// Value of attribute `name` in an XML start tag. INDI quotes with either ' or ".
+static std::string attribute(const std::string &head, const char *name)
+{
+    size_t length = strlen(name);
+
+    for (size_t at = head.find(name); at != std::string::npos; at = head.find(name, at + 1))
+    {
+        size_t quote = at + length + 1;
+        if (at == 0 || !isspace(static_cast<unsigned char>(head[at - 1])) ||
+            quote >= head.size() || head[at + length] != '=')
+            continue;
+
+        size_t end = head.find(head[quote], quote + 1);
+        if (end == std::string::npos)
+            return "";
+        return head.substr(quote + 1, end - quote - 1);
+    }
+
+    return "";
+}
+
+bool DriverHarness::start()
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0)
+    {
+        perror("posix_openpt");
+        return false;
+    }
+
+    m_port = ptsname(m_master);
+
+    // Held open so the master doesn't see EIO between the driver's opens.
+    m_slave = open(m_port.c_str(), O_RDWR | O_NOCTTY);
+    if (m_slave < 0)
+    {
+        perror(m_port.c_str());
+        return false;
+    }
+
+    struct termios tio;
+    tcgetattr(m_slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_slave, TCSANOW, &tio);
+
+    fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+    int toDriver[2], fromDriver[2];
+    if (pipe(toDriver) != 0 || pipe(fromDriver) != 0)
+    {
+        perror("pipe");
+        return false;
+    }
+
+    m_driver = fork();
+    if (m_driver < 0)
+    {
+        perror("fork");
+        return false;
+    }
+
+    if (m_driver == 0)
+    {
+        dup2(toDriver[0], STDIN_FILENO);
+        dup2(fromDriver[1], STDOUT_FILENO);
+
+        if (!m_options.verbose)
+        {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+
+        close(toDriver[0]);
+        close(toDriver[1]);
+        close(fromDriver[0]);
+        close(fromDriver[1]);
+        close(m_slave);
+        close(m_master);
+
+        execlp(m_options.driver, m_options.driver, static_cast<char *>(nullptr));
+        perror(m_options.driver);
+        _exit(127);
+    }
+
+    close(toDriver[0]);
+    close(fromDriver[1]);
+    m_toDriver   = toDriver[1];
+    m_fromDriver = fromDriver[0];
+
+    fcntl(m_fromDriver, F_SETFL, fcntl(m_fromDriver, F_GETFL) | O_NONBLOCK);
+
+    m_mountTime = Clock::now();
+
+    sendXML("<getProperties version='1.7'/>\n");
+    return true;
+}
+
+void DriverHarness::stop()
+{
+    if (m_driver > 0)
+    {
+        // A driver exits when its stdin closes; don't count on it.
+        close(m_toDriver);
+        m_toDriver = -1;
+        pumpFor(0.2);
+        kill(m_driver, SIGTERM);
+        waitpid(m_driver, nullptr, 0);
+        m_driver = -1;
+    }
+
+    close(m_fromDriver);
+    close(m_slave);
+    close(m_master);
+}
+
+bool DriverHarness::connect()
+{
+    PropertyUpdate update;
+
+    if (!waitForProperty(Clock::time_point(), "DEVICE_PORT", nullptr, 10, update))
+    {
+        fprintf(stderr, "driver never defined DEVICE_PORT\n");
+        return false;
+    }
+
+    Clock::time_point since = Clock::now();
+    newText("DEVICE_PORT", "PORT", port());
+    newSwitch("CONNECTION", "CONNECT");
+
+    if (!waitForProperty(since, "CONNECTION", "Ok", 15, update))
+    {
+        fprintf(stderr, "driver didn't connect to %s\n", port());
+        return false;
+    }
+
+    return true;
+}
+
+bool DriverHarness::pumpUntil(const std::function<bool()> &done, double seconds)
+{
+    Clock::time_point deadline =
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double>(seconds));
+
+    while (!done())
+    {
+        if (Clock::now() >= deadline || !pump(deadline))
+            return false;
+    }
+
+    return true;
+}
+
+bool DriverHarness::pump(Clock::time_point deadline)
+{
+    Clock::time_point wake = std::min(deadline, Clock::now() + std::chrono::milliseconds(5));
+    if (!m_outgoing.empty())
+        wake = std::min(wake, m_outgoing.front().due);
+
+    int timeout = static_cast<int>(std::max(0.0, ceil(millisecondsBetween(Clock::now(), wake))));
+
+    struct pollfd fds[2] = { { m_master, POLLIN, 0 }, { m_fromDriver, POLLIN, 0 } };
+    poll(fds, 2, timeout);
+
+    Clock::time_point now = Clock::now();
+
+    m_mount.advance(std::chrono::duration<double>(now - m_mountTime).count() * m_options.speed);
+    m_mountTime = now;
+
+    if (fds[0].revents & POLLIN)
+        readRequests(now);
+
+    if ((fds[1].revents & (POLLIN | POLLHUP)) && !readDriver(now))
+    {
+        if (m_toDriver >= 0)
+            fprintf(stderr, "driver exited\n");
+        return false;
+    }
+
+    writeReplies(Clock::now());
+    return true;
+}
+
+void DriverHarness::readRequests(Clock::time_point now)
+{
+    unsigned char bytes[256];
+    ssize_t n = read(m_master, bytes, sizeof(bytes));
+    if (n <= 0)
+        return;
+
+    const unsigned char *data = bytes;
+    size_t left               = n;
+    while (left > 0)
+    {
+        size_t accepted = m_decoder.feed(data, left);
+        data += accepted;
+        left -= accepted;
+
+        WireFrame frame;
+        frame.time = now;
+        while (m_decoder.next(frame.cmd))
+            requests.push_back(frame);
+    }
+
+    m_mount.receive(bytes, n);
+
+    // Replies go out back to back, each after the reply delay and its bytes' time on the wire.
+    buffer reply;
+    while (m_mount.nextFrame(reply))
+    {
+        Clock::time_point start = now + std::chrono::microseconds(m_options.replyUs);
+        if (!m_outgoing.empty())
+            start = std::max(start, m_outgoing.back().due);
+
+        Outgoing out;
+        out.due   = start + std::chrono::microseconds(m_options.byteUs * reply.size());
+        out.frame = reply;
+        m_outgoing.push_back(out);
+    }
+}
+
+void DriverHarness::writeReplies(Clock::time_point now)
+{
+    // Announcements come out of the mount on its own, outside any request.
+    buffer frame;
+    while (m_mount.nextFrame(frame))
+    {
+        Outgoing out;
+        out.due   = now + std::chrono::microseconds(m_options.byteUs * frame.size());
+        out.frame = frame;
+        m_outgoing.push_back(out);
+    }
+
+    while (!m_outgoing.empty() && m_outgoing.front().due <= now)
+    {
+        const buffer &out = m_outgoing.front().frame;
+        if (write(m_master, out.data(), out.size()) == static_cast<ssize_t>(out.size()))
+        {
+            WireFrame reply;
+            reply.time = now;
+            reply.cmd  = AUXCommand(out);
+            replies.push_back(reply);
+        }
+        m_outgoing.pop_front();
+    }
+}
+
+bool DriverHarness::readDriver(Clock::time_point now)
+{
+    char chunk[4096];
+    ssize_t n = read(m_fromDriver, chunk, sizeof(chunk));
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+        return false;
+
+    if (n > 0)
+    {
+        if (m_options.verbose)
+            fwrite(chunk, 1, n, stderr);
+
+        m_xml.append(chunk, n);
+        parseXML(now);
+    }
+
+    return true;
+}
+
+void DriverHarness::parseXML(Clock::time_point now)
+{
+    size_t pos = 0;
+
+    for (;;)
+    {
+        size_t open = m_xml.find('<', pos);
+        if (open == std::string::npos)
+        {
+            pos = m_xml.size();
+            break;
+        }
+
+        size_t headEnd = m_xml.find('>', open);
+        if (headEnd == std::string::npos)
+        {
+            pos = open;
+            break;
+        }
+
+        std::string head = m_xml.substr(open, headEnd - open);
+        std::string tag  = head.substr(1, head.find_first_of(" \t\r\n/", 1) - 1);
+        size_t end       = headEnd + 1;
+
+        // Top level elements are either self closing or end at their own closing tag.
+        if (m_xml[headEnd - 1] != '/')
+        {
+            size_t close = m_xml.find("</" + tag + ">", headEnd);
+            if (close == std::string::npos)
+            {
+                pos = open;
+                break;
+            }
+            end = close + tag.size() + 3;
+        }
+
+        if ((tag.compare(0, 3, "set") == 0 || tag.compare(0, 3, "def") == 0) &&
+            tag.size() > 6 && tag.compare(tag.size() - 6, 6, "Vector") == 0)
+        {
+            PropertyUpdate update;
+            update.time  = now;
+            update.tag   = tag;
+            update.name  = attribute(head, "name");
+            update.state = attribute(head, "state");
+
+            if (tag.compare(3, 6, "Number") == 0)
+            {
+                const char *element = tag[0] == 's' ? "<oneNumber" : "<defNumber";
+                for (size_t at = m_xml.find(element, headEnd); at < end;
+                     at        = m_xml.find(element, at + 1))
+                {
+                    size_t valueStart = m_xml.find('>', at);
+                    if (valueStart >= end)
+                        break;
+
+                    std::string elementHead = m_xml.substr(at, valueStart - at);
+                    double value            = strtod(m_xml.c_str() + valueStart + 1, nullptr);
+                    update.numbers.push_back(
+                        std::make_pair(attribute(elementHead, "name"), value));
+                }
+            }
+
+            if (tag.compare(3, 6, "Switch") == 0)
+            {
+                const char *element = tag[0] == 's' ? "<oneSwitch" : "<defSwitch";
+                for (size_t at = m_xml.find(element, headEnd); at < end;
+                     at        = m_xml.find(element, at + 1))
+                {
+                    size_t valueStart = m_xml.find('>', at);
+                    if (valueStart >= end)
+                        break;
+
+                    std::string elementHead = m_xml.substr(at, valueStart - at);
+                    size_t value = m_xml.find_first_not_of(" \t\r\n", valueStart + 1);
+                    if (value < end && m_xml.compare(value, 2, "On") == 0)
+                        update.switchesOn.push_back(attribute(elementHead, "name"));
+                }
+            }
+
+            properties.push_back(update);
+        }
+
+        pos = end;
+    }
+
+    m_xml.erase(0, pos);
+}
+
+void DriverHarness::sendXML(const std::string &xml)
+{
+    if (write(m_toDriver, xml.data(), xml.size()) != static_cast<ssize_t>(xml.size()))
+        perror("write to driver");
+}
+
+void DriverHarness::newNumber(const char *property, const NumberValues &values)
+{
+    std::string xml = std::string("<newNumberVector device='") + m_options.device + "' name='" +
+                      property + "'>\n";
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        char value[32];
+        snprintf(value, sizeof(value), "%.8f", values[i].second);
+        xml += "  <oneNumber name='" + values[i].first + "'>" + value + "</oneNumber>\n";
+    }
+    xml += "</newNumberVector>\n";
+
+    sendXML(xml);
+}
+
+void DriverHarness::newSwitch(const char *property, const char *element)
+{
+    sendXML(std::string("<newSwitchVector device='") + m_options.device + "' name='" + property +
+            "'>\n  <oneSwitch name='" + element + "'>On</oneSwitch>\n</newSwitchVector>\n");
+}
+
+void DriverHarness::newText(const char *property, const char *element, const char *text)
+{
+    sendXML(std::string("<newTextVector device='") + m_options.device + "' name='" + property +
+            "'>\n  <oneText name='" + element + "'>" + text + "</oneText>\n</newTextVector>\n");
+}
+
+bool DriverHarness::waitForRequest(Clock::time_point since,
+                             const std::function<bool(const AUXCommand &)> &match, double seconds,
+                             WireFrame &frame)
+{
+    const WireFrame *found = nullptr;
+    pumpUntil(
+        [&]() {
+            found = findAfter(requests, since, [&](const WireFrame &f) { return match(f.cmd); });
+            return found != nullptr;
+        },
+        seconds);
+
+    if (found == nullptr)
+        return false;
+
+    frame = *found;
+    return true;
+}
+
+bool DriverHarness::waitForProperty(Clock::time_point since, const char *name, const char *state,
+                              double seconds, PropertyUpdate &update)
+{
+    const PropertyUpdate *found = nullptr;
+    pumpUntil(
+        [&]() {
+            found = findAfter(properties, since, [&](const PropertyUpdate &p) {
+                return p.name == name && (state == nullptr || p.state == state);
+            });
+            return found != nullptr;
+        },
+        seconds);
+
+    if (found == nullptr)
+        return false;
+
+    update = *found;
+    return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include "auxdecoder.h"
+#include "auxmount.h"
+
+/*
+Runs the driver as a child process and talks INDI XML to it on its stdin and stdout, the way
+indiserver would, with an AUXMount on a pseudo-terminal as its serial port. Used by the latency
+and replay tools.
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+struct HarnessOptions
+{
+    const char *driver{"indi_celestron_cgx"};
+    const char *device{"Celestron CGX"};
+    // How much faster than real time the mount's clock runs.
+    double speed{1};
+    // Modelled link: the time each byte takes on the wire, and the mount's time to answer.
+    int byteUs{0};
+    int replyUs{0};
+    // Pass the driver's stderr and XML through to ours.
+    bool verbose{false};
+};
+
+// A frame on the wire, in either direction, and when it got there.
+struct WireFrame
+{
+    Clock::time_point time;
+    AUXCommand cmd;
+};
+
+// A def or set vector from the driver.
+struct PropertyUpdate
+{
+    Clock::time_point time;
+    std::string tag;
+    std::string name;
+    std::string state;
+    // The oneNumber elements of a number vector, in order.
+    std::vector<std::pair<std::string, double>> numbers;
+    // The elements of a switch vector that are On.
+    std::vector<std::string> switchesOn;
+
+    double number(const char *element) const;
+};
+
+typedef std::vector<std::pair<std::string, double>> NumberValues;
+
+inline double millisecondsBetween(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// First item in `items` at or after `since` that passes `match`, or the nth such counting from 0.
+template <typename T, typename Match>
+const T *findAfter(const std::vector<T> &items, Clock::time_point since, Match match,
+                   size_t nth = 0)
+{
+    typename std::vector<T>::const_iterator it =
+        std::lower_bound(items.begin(), items.end(), since,
+                         [](const T &item, Clock::time_point t) { return item.time < t; });
+
+    for (; it != items.end(); ++it)
+    {
+        if (match(*it) && nth-- == 0)
+            return &*it;
+    }
+
+    return nullptr;
+}
+
+/*
+Owns the driver process and shuttles bytes between it and the mount. Everything either side sends
+is recorded with the time it arrived, and the wait functions run the loop until something matching
+shows up.
+*/
+class DriverHarness
+{
+  public:
+    DriverHarness(AUXMount &mount, const HarnessOptions &options)
+        : m_options(options), m_mount(mount)
+    {
+    }
+
+    bool start();
+    void stop();
+
+    const char *port() const
+    {
+        return m_port.c_str();
+    }
+
+    // Points the driver at the pty and connects it.
+    bool connect();
+
+    // Runs the loop until done() returns true or `seconds` pass. Returns whether done() did.
+    bool pumpUntil(const std::function<bool()> &done, double seconds);
+    void pumpFor(double seconds)
+    {
+        pumpUntil([]() { return false; }, seconds);
+    }
+
+    void newNumber(const char *property, const NumberValues &values);
+    void newSwitch(const char *property, const char *element);
+    void newText(const char *property, const char *element, const char *text);
+
+    // Frames the driver sent to the mount.
+    bool waitForRequest(Clock::time_point since,
+                        const std::function<bool(const AUXCommand &)> &match, double seconds,
+                        WireFrame &frame);
+    // Property updates from the driver. A null state matches any state.
+    bool waitForProperty(Clock::time_point since, const char *name, const char *state,
+                         double seconds, PropertyUpdate &update);
+
+    std::vector<WireFrame> requests;
+    std::vector<WireFrame> replies;
+    std::vector<PropertyUpdate> properties;
+
+  private:
+    struct Outgoing
+    {
+        Clock::time_point due;
+        buffer frame;
+    };
+
+    bool pump(Clock::time_point deadline);
+    void readRequests(Clock::time_point now);
+    void writeReplies(Clock::time_point now);
+    bool readDriver(Clock::time_point now);
+    void parseXML(Clock::time_point now);
+    void sendXML(const std::string &xml);
+
+    const HarnessOptions &m_options;
+    AUXMount &m_mount;
+
+    int m_master{-1};
+    int m_slave{-1};
+    std::string m_port;
+
+    pid_t m_driver{-1};
+    int m_toDriver{-1};
+    int m_fromDriver{-1};
+    std::string m_xml;
+
+    AUXFrameDecoder m_decoder;
+    Clock::time_point m_mountTime;
+    // Replies waiting on the modelled link delay.
+    std::deque<Outgoing> m_outgoing;
+};
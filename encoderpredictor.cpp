@@ -0,0 +1,128 @@
+#include "encoderpredictor.h"
+
+#include <cmath>
+#include <cstdlib>
+
+EncoderPredictor::EncoderPredictor(uint32_t stepsPerRevolution)
+{
+    m_stepsPerRevolution = stepsPerRevolution;
+    // About 20 arcseconds.
+    m_toleranceSteps = stepsPerRevolution / 64800;
+}
+
+void EncoderPredictor::setRate(int axis, double stepsPerSecond, Clock::time_point now)
+{
+    Axis &a = m_axes[axis];
+
+    // Carry on from where the old rate would have taken us.
+    if (a.sampled)
+    {
+        a.steps = predict(axis, now);
+        a.time  = now;
+    }
+
+    a.rate      = stepsPerSecond;
+    a.rateKnown = true;
+    a.verified  = false;
+}
+
+void EncoderPredictor::setRateUnknown(int axis)
+{
+    m_axes[axis].rateKnown     = false;
+    m_axes[axis].rateEstimated = false;
+    m_axes[axis].verified      = false;
+}
+
+void EncoderPredictor::reset()
+{
+    for (int i = 0; i < AXES; i++)
+        m_axes[i] = Axis();
+}
+
+bool EncoderPredictor::sample(int axis, uint32_t steps, Clock::time_point now)
+{
+    Axis &a = m_axes[axis];
+
+    bool matched = true;
+
+    if (a.sampled && !a.rateKnown && !a.rateEstimated)
+    {
+        // Nothing to check against yet; this reading and the last give us a rate to try.
+        double seconds = std::chrono::duration<double>(now - a.time).count();
+        if (seconds > 0)
+            a.rate = difference(steps, a.steps) / seconds;
+
+        a.rateEstimated = true;
+        a.verified      = false;
+    }
+    else if (a.sampled)
+    {
+        int64_t error = difference(steps, predict(axis, now));
+        matched       = std::abs(error) <= static_cast<int64_t>(m_toleranceSteps);
+
+        if (!matched)
+        {
+            m_divergences++;
+            // Whatever we commanded or estimated isn't what the motor is doing.
+            a.rateKnown     = false;
+            a.rateEstimated = false;
+        }
+        else if (!a.rateKnown)
+        {
+            // Follow changes in speed, e.g. while a goto accelerates.
+            double seconds = std::chrono::duration<double>(now - a.time).count();
+            if (seconds > 0)
+                a.rate = difference(steps, a.steps) / seconds;
+        }
+
+        a.verified = matched;
+    }
+
+    a.sampled = true;
+    a.steps   = steps;
+    a.time    = now;
+
+    return matched;
+}
+
+uint32_t EncoderPredictor::predict(int axis, Clock::time_point now) const
+{
+    const Axis &a = m_axes[axis];
+
+    double seconds = std::chrono::duration<double>(now - a.time).count();
+
+    return wrap(static_cast<int64_t>(a.steps) + std::llround(a.rate * seconds));
+}
+
+bool EncoderPredictor::confident() const
+{
+    for (int i = 0; i < AXES; i++)
+    {
+        if (!m_axes[i].verified)
+            return false;
+    }
+
+    return true;
+}
+
+int64_t EncoderPredictor::difference(uint32_t a, uint32_t b) const
+{
+    int64_t d    = (static_cast<int64_t>(a) - b) % m_stepsPerRevolution;
+    int64_t half = m_stepsPerRevolution / 2;
+
+    if (d > half)
+        d -= m_stepsPerRevolution;
+    else if (d < -half)
+        d += m_stepsPerRevolution;
+
+    return d;
+}
+
+uint32_t EncoderPredictor::wrap(int64_t steps) const
+{
+    int64_t wrapped = steps % m_stepsPerRevolution;
+    if (wrapped < 0)
+        wrapped += m_stepsPerRevolution;
+
+    return static_cast<uint32_t>(wrapped);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+Extrapolates the motor encoders between position polls.
+
+Each axis keeps its last real reading and a rate: the one we commanded (e.g. the tracking rate)
+when we know it, or one estimated from consecutive readings while the motor does something we
+can't model exactly, like a goto. Every reading is checked against what was predicted for it. A
+miss by more than the tolerance throws the rate away; the next reading yields a new estimate and
+the one after that has to confirm it. Only while both axes are confident can polls be spread out.
+*/
+class EncoderPredictor
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int AXES = 2;
+
+    explicit EncoderPredictor(uint32_t stepsPerRevolution);
+
+    void setTolerance(uint32_t steps)
+    {
+        m_toleranceSteps = steps;
+    }
+
+    // The motor was told to turn at this rate; 0 stops it.
+    void setRate(int axis, double stepsPerSecond, Clock::time_point now);
+    // The motor was told to do something we can't model; estimate its rate from readings.
+    void setRateUnknown(int axis);
+    // Forget everything, e.g. after reconnecting or a sync moved the encoders.
+    void reset();
+
+    // Records a real reading. Returns false if it was further off the prediction than the
+    // tolerance.
+    bool sample(int axis, uint32_t steps, Clock::time_point now);
+    // Only meaningful once the axis has been sampled since the last reset().
+    uint32_t predict(int axis, Clock::time_point now) const;
+    bool sampled(int axis) const
+    {
+        return m_axes[axis].sampled;
+    }
+
+    bool confident() const;
+    uint32_t divergences() const
+    {
+        return m_divergences;
+    }
+
+  private:
+    struct Axis
+    {
+        bool sampled{false};
+        bool rateKnown{false};
+        // rate was worked out from the last two readings.
+        bool rateEstimated{false};
+        // The latest reading matched what was predicted for it.
+        bool verified{false};
+        uint32_t steps{0};
+        Clock::time_point time;
+        double rate{0};
+    };
+
+    // Shortest signed distance from b to a, in steps.
+    int64_t difference(uint32_t a, uint32_t b) const;
+    uint32_t wrap(int64_t steps) const;
+
+    uint32_t m_stepsPerRevolution;
+    uint32_t m_toleranceSteps;
+    uint32_t m_divergences{0};
+    Axis m_axes[AXES];
+};
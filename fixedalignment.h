@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pointingmodel.h"
+#include "siderealclock.h"
+#include "simplealignment.h"
+
+/*
+EQAlignment for a mount whose encoders count a power of two steps per revolution, fixed at compile
+time (2^24 on the CGX).
+
+Angles are kept as steps modulo one revolution, so a step is exactly 1/STEPS of a turn and
+wrapping is a mask: hour angles, pier side flips and the offset from home can't go negative or
+overflow. Converting hours or degrees to steps is a single multiply by a power of two and one
+division, so steps -> RA/Dec -> steps gives back the same steps.
+
+Every RA/Dec conversion goes through the pointing terms, when there are some; the encoder helpers
+below them work on the bare geometry.
+
+The interface matches EQAlignment, so the driver can use either.
+*/
+template <uint32_t STEPS>
+class FixedEQAlignment
+{
+    static_assert(STEPS >= 4 && (STEPS & (STEPS - 1)) == 0,
+                  "steps per revolution must be a power of two");
+
+  public:
+    typedef EQAlignment::TelescopePierSide TelescopePierSide;
+
+    static const uint32_t STEPS_PER_REVOLUTION = STEPS;
+    static const uint32_t MASK                 = STEPS - 1;
+    static const uint32_t HALF_TURN            = STEPS >> 1;
+    // Counterweight down, pointing at the pole: 6h on RA, the middle of the range on Dec.
+    static const uint32_t HOME_RA  = STEPS >> 2;
+    static const uint32_t HOME_DEC = STEPS >> 1;
+
+    static uint32_t wrap(int64_t steps)
+    {
+        return static_cast<uint32_t>(steps) & MASK;
+    }
+    static uint32_t stepsFromHours(double hours)
+    {
+        return wrap(std::llround(hours * STEPS / 24.0));
+    }
+    static double hoursFromSteps(uint32_t steps)
+    {
+        return (steps & MASK) * 24.0 / STEPS;
+    }
+    static int64_t stepsFromDegrees(double degrees)
+    {
+        return std::llround(degrees * STEPS / 360.0);
+    }
+    static double degreesFromSteps(int64_t steps)
+    {
+        return steps * 360.0 / STEPS;
+    }
+
+    void UpdateSteps(uint32_t ra, uint32_t dec)
+    {
+        m_raSteps  = ra;
+        m_decSteps = dec;
+    }
+    void UpdateStepsRA(uint32_t steps)
+    {
+        m_raSteps = steps;
+    }
+    void UpdateStepsDec(uint32_t steps)
+    {
+        m_decSteps = steps;
+    }
+    void UpdateLongitude(double lng)
+    {
+        m_clock.setLongitude(lng);
+    }
+    void setPointingTerms(const PointingTerms &terms)
+    {
+        m_terms = terms;
+    }
+
+    void EncoderValuesFromRADec(double ra, double dec, uint32_t &raSteps, uint32_t &decSteps,
+                                TelescopePierSide &pierSide)
+    {
+        EncoderValuesFromRADec(localSiderealTime(), 1, &ra, &dec, &raSteps, &decSteps, &pierSide);
+    }
+
+    // The same, from the given side of the pier whatever the hour angle says. Near the meridian
+    // the other side is just a little counterweight up.
+    void EncoderValuesFromRADec(double ra, double dec, TelescopePierSide pierSide,
+                                uint32_t &raSteps, uint32_t &decSteps)
+    {
+        uint32_t hourAngle = (stepsFromHours(localSiderealTime()) - stepsFromHours(ra)) & MASK;
+        bool west          = pierSide == EQAlignment::PIER_WEST;
+
+        raSteps  = (hourAngle + (west ? HALF_TURN : 0)) & MASK;
+        decSteps = encoderFromDecAndPierSide(dec, pierSide);
+        m_terms.toEncoder(raSteps, decSteps);
+    }
+
+    void RADecFromEncoderValues(double &ra, double &dec, TelescopePierSide &pierSide)
+    {
+        RADecFromEncoderValues(localSiderealTime(), 1, &m_raSteps, &m_decSteps, &ra, &dec,
+                               &pierSide);
+    }
+
+    void EncoderValuesFromRADec(double lst, size_t count, const double *ra, const double *dec,
+                                uint32_t *raSteps, uint32_t *decSteps,
+                                TelescopePierSide *pierSide) const
+    {
+        const uint32_t lstSteps = stepsFromHours(lst);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t hourAngle = (lstSteps - stepsFromHours(ra[i])) & MASK;
+            // Hour angles in [12h, 24h) and 0 are at or west of the meridian.
+            bool west = hourAngle == 0 || hourAngle >= HALF_TURN;
+
+            int64_t offset = stepsFromDegrees(90.0 - dec[i]);
+
+            raSteps[i]  = (hourAngle + (west ? HALF_TURN : 0)) & MASK;
+            decSteps[i] = wrap(west ? HOME_DEC - offset : HOME_DEC + offset);
+            pierSide[i] = west ? EQAlignment::PIER_WEST : EQAlignment::PIER_EAST;
+        }
+
+        // Apart, so the loop above still vectorizes.
+        if (m_terms.active())
+        {
+            for (size_t i = 0; i < count; i++)
+                m_terms.toEncoder(raSteps[i], decSteps[i]);
+        }
+    }
+
+    void RADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                const uint32_t *decSteps, double *ra, double *dec,
+                                TelescopePierSide *pierSide) const
+    {
+        if (!m_terms.active())
+        {
+            idealRADecFromEncoderValues(lst, count, raSteps, decSteps, ra, dec, pierSide);
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t raIdeal  = raSteps[i];
+            uint32_t decIdeal = decSteps[i];
+            m_terms.toIdeal(raIdeal, decIdeal);
+            idealRADecFromEncoderValues(lst, 1, &raIdeal, &decIdeal, &ra[i], &dec[i],
+                                        &pierSide[i]);
+        }
+    }
+
+    // The encoder counts hour angle directly, with home at 6h.
+    double hourAngleFromEncoder()
+    {
+        return hoursFromSteps(m_raSteps);
+    }
+    uint32_t encoderFromHourAngle(double hourAngle)
+    {
+        return stepsFromHours(hourAngle);
+    }
+
+    void decAndPierSideFromEncoder(double &dec, TelescopePierSide &pierSide)
+    {
+        bool west      = m_decSteps <= HOME_DEC;
+        int64_t offset = west ? HOME_DEC - m_decSteps : m_decSteps - HOME_DEC;
+
+        dec      = 90.0 - degreesFromSteps(offset);
+        pierSide = west ? EQAlignment::PIER_WEST : EQAlignment::PIER_EAST;
+    }
+    uint32_t encoderFromDecAndPierSide(double dec, TelescopePierSide pierSide)
+    {
+        int64_t offset = stepsFromDegrees(90.0 - dec);
+        return wrap(pierSide == EQAlignment::PIER_WEST ? HOME_DEC - offset : HOME_DEC + offset);
+    }
+
+    double localSiderealTime()
+    {
+        return m_clock.localSiderealTime();
+    }
+    double localSiderealTime(double julianDate) const
+    {
+        return m_clock.localSiderealTimeAt(julianDate);
+    }
+
+    void holdTime()
+    {
+        m_clock.hold();
+    }
+    void releaseTime()
+    {
+        m_clock.release();
+    }
+
+    TelescopePierSide expectedPierSide(double ra)
+    {
+        uint32_t hourAngle = (stepsFromHours(localSiderealTime()) - stepsFromHours(ra)) & MASK;
+        return hourAngle == 0 || hourAngle >= HALF_TURN ? EQAlignment::PIER_WEST
+                                                         : EQAlignment::PIER_EAST;
+    }
+
+    uint32_t GetStepsAtHomePositionDec()
+    {
+        return HOME_DEC;
+    }
+    uint32_t GetStepsAtHomePositionRA()
+    {
+        return HOME_RA;
+    }
+
+  private:
+    void idealRADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                     const uint32_t *decSteps, double *ra, double *dec,
+                                     TelescopePierSide *pierSide) const
+    {
+        const uint32_t lstSteps = stepsFromHours(lst);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            bool west = decSteps[i] <= HOME_DEC;
+
+            int64_t offset = west ? HOME_DEC - decSteps[i] : decSteps[i] - HOME_DEC;
+
+            ra[i]       = hoursFromSteps(lstSteps - raSteps[i] - (west ? HALF_TURN : 0));
+            dec[i]      = 90.0 - degreesFromSteps(offset);
+            pierSide[i] = west ? EQAlignment::PIER_WEST : EQAlignment::PIER_EAST;
+        }
+    }
+
+    uint32_t m_raSteps{HOME_RA};
+    uint32_t m_decSteps{HOME_DEC};
+
+    SiderealClock m_clock;
+    PointingTerms m_terms;
+};
+
+template <uint32_t STEPS>
+const uint32_t FixedEQAlignment<STEPS>::STEPS_PER_REVOLUTION;
+template <uint32_t STEPS>
+const uint32_t FixedEQAlignment<STEPS>::MASK;
+template <uint32_t STEPS>
+const uint32_t FixedEQAlignment<STEPS>::HALF_TURN;
+template <uint32_t STEPS>
+const uint32_t FixedEQAlignment<STEPS>::HOME_RA;
+template <uint32_t STEPS>
+const uint32_t FixedEQAlignment<STEPS>::HOME_DEC;
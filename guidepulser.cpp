@@ -0,0 +1,49 @@
+#include "guidepulser.h"
+
+#include <cmath>
+
+const uint32_t GuidePulser::TICK_MS;
+const uint32_t GuidePulser::MAX_TICKS;
+
+int32_t GuidePulser::start(int32_t ms)
+{
+    double total = ms + m_carryMs;
+    double ticks = std::floor(std::fabs(total) / TICK_MS);
+
+    m_sign      = total < 0 ? -1 : 1;
+    m_ticksLeft = static_cast<uint32_t>(ticks);
+    m_ticksSent = 0;
+    m_carryMs   = total - m_sign * ticks * TICK_MS;
+
+    return m_sign * static_cast<int32_t>(m_ticksLeft * TICK_MS);
+}
+
+bool GuidePulser::next(Segment &segment, Clock::time_point now)
+{
+    if (m_ticksLeft == 0)
+        return false;
+
+    uint32_t ticks = m_ticksLeft < MAX_TICKS ? m_ticksLeft : MAX_TICKS;
+
+    segment.sign  = m_sign;
+    segment.ticks = static_cast<uint8_t>(ticks);
+
+    m_ticksLeft -= ticks;
+    m_ticksSent += ticks;
+    m_endsAt = now + std::chrono::milliseconds(segment.ms());
+
+    return true;
+}
+
+void GuidePulser::cancel()
+{
+    m_ticksLeft = 0;
+    m_endsAt    = Clock::time_point();
+}
+
+void GuidePulser::reset()
+{
+    cancel();
+    m_ticksSent = 0;
+    m_carryMs   = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+Turns guide pulses of any length into the MC_AUX_GUIDE segments one motor axis can run.
+
+The motor takes a pulse as a count of 10 ms ticks, at most 255 of them. A longer pulse is split
+into segments that the driver sends back to back, each when the one before should have ended.
+Whatever is left below a tick is carried over and added to the next pulse on the same axis, so a
+run of short corrections adds up to what was asked for instead of rounding to nothing. Durations
+are signed: positive is north or west, negative south or east.
+*/
+class GuidePulser
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const uint32_t TICK_MS   = 10;
+    static const uint32_t MAX_TICKS = 255;
+
+    struct Segment
+    {
+        // +1 or -1.
+        int sign;
+        uint8_t ticks;
+        uint32_t ms() const
+        {
+            return ticks * TICK_MS;
+        }
+    };
+
+    // Starts a pulse, dropping whatever is left of the last one. Returns the milliseconds it
+    // will deliver, carry included.
+    int32_t start(int32_t ms);
+    // The segment to send now. False once the whole pulse has gone out.
+    bool next(Segment &segment, Clock::time_point now);
+    // Drops the segments not sent yet, e.g. on abort. They aren't carried over.
+    void cancel();
+    void reset();
+
+    // Segments are still to go out.
+    bool pending() const
+    {
+        return m_ticksLeft > 0;
+    }
+    // The motor may still be moving: segments are to go out, or the last one hasn't run out.
+    bool busy(Clock::time_point now) const
+    {
+        return pending() || now < m_endsAt;
+    }
+
+    // Milliseconds of the current pulse sent so far, signed like the pulse.
+    int32_t delivered() const
+    {
+        return m_sign * static_cast<int32_t>(m_ticksSent * TICK_MS);
+    }
+    // Below a tick, waiting for the next pulse.
+    double carried() const
+    {
+        return m_carryMs;
+    }
+
+  private:
+    int m_sign{1};
+    uint32_t m_ticksLeft{0};
+    uint32_t m_ticksSent{0};
+    double m_carryMs{0};
+    Clock::time_point m_endsAt;
+};
@@ -0,0 +1,69 @@
+#include "numberpublisher.h"
+
+#include <cmath>
+
+#include <libindi/indidevapi.h>
+
+void NumberPublisher::attach(INumberVectorProperty *property, double threshold)
+{
+    m_property  = property;
+    m_threshold = threshold;
+    m_force     = true;
+}
+
+void NumberPublisher::set(int index, double value)
+{
+    if (m_property == nullptr || index < 0 || index >= m_property->nnp)
+        return;
+
+    m_property->np[index].value = value;
+}
+
+void NumberPublisher::setState(IPState state)
+{
+    if (m_property != nullptr)
+        m_property->s = state;
+}
+
+bool NumberPublisher::flush(Clock::time_point now)
+{
+    if (m_property == nullptr)
+        return false;
+
+    int count = m_property->nnp;
+    if (count > MAX_ELEMENTS)
+        count = MAX_ELEMENTS;
+
+    bool changed = m_force || m_property->s != m_publishedState;
+    for (int i = 0; i < count && !changed; i++)
+    {
+        double delta = std::fabs(m_property->np[i].value - m_published[i]);
+        changed      = m_threshold > 0 ? delta >= m_threshold : delta > 0;
+    }
+
+    if (!changed)
+        return false;
+
+    // A state change always goes out right away; only value churn is rate limited.
+    if (!m_force && m_property->s == m_publishedState && m_minIntervalMs > 0 &&
+        now - m_lastPublish < std::chrono::milliseconds(m_minIntervalMs))
+        return false;
+
+    publish(now);
+
+    return true;
+}
+
+void NumberPublisher::publish(Clock::time_point now)
+{
+    if (m_property == nullptr)
+        return;
+
+    IDSetNumber(m_property, nullptr);
+
+    for (int i = 0; i < m_property->nnp && i < MAX_ELEMENTS; i++)
+        m_published[i] = m_property->np[i].value;
+    m_publishedState = m_property->s;
+    m_lastPublish    = now;
+    m_force          = false;
+}
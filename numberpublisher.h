@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+
+#include <libindi/indiapi.h>
+
+/*
+Sends a number property to clients only when it has actually changed.
+
+Values are written through set() as replies come in, and flush() at the end of a poll cycle sends
+at most one update: only if some element moved by at least its threshold since the last update (or
+the state changed) and the property hasn't been sent within the minimum interval. Anything held
+back by the interval goes out on a later flush.
+*/
+class NumberPublisher
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int MAX_ELEMENTS = 8;
+
+    // threshold applies to every element; 0 publishes any change at all.
+    void attach(INumberVectorProperty *property, double threshold);
+
+    void setMinInterval(int ms)
+    {
+        m_minIntervalMs = ms;
+    }
+
+    void set(int index, double value);
+    void setState(IPState state);
+
+    // The next flush publishes whatever the values are, e.g. after the property was redefined.
+    void invalidate()
+    {
+        m_force = true;
+    }
+
+    // Returns true if an update was sent.
+    bool flush(Clock::time_point now);
+    // Sends right away, e.g. to acknowledge a client's change.
+    void publish(Clock::time_point now);
+
+  private:
+    INumberVectorProperty *m_property{nullptr};
+    double m_threshold{0};
+    int m_minIntervalMs{0};
+
+    double m_published[MAX_ELEMENTS];
+    IPState m_publishedState{IPS_IDLE};
+    Clock::time_point m_lastPublish;
+    bool m_force{true};
+};
@@ -0,0 +1,322 @@
+#include "pointingmodel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_multifit.h>
+
+const size_t PointingModel::MAX_POINTS;
+
+static const double DEGREES = M_PI / 180;
+// sec d and tan d are held to what they are half a degree off the pole.
+static const double MIN_COS_DEC = 0.0087;
+
+// Into (-180, 180], for hour angle differences.
+static double wrap180(double degrees)
+{
+    degrees = std::fmod(degrees, 360.0);
+    if (degrees > 180)
+        return degrees - 360;
+    if (degrees <= -180)
+        return degrees + 360;
+    return degrees;
+}
+
+PointingTerms::PointingTerms()
+{
+    std::fill(m_coefficients, m_coefficients + TERM_COUNT, 0.0);
+}
+
+PointingTerms::PointingTerms(uint32_t stepsPerRevolution, uint32_t homeDec, double latitude)
+    : PointingTerms()
+{
+    m_stepsPerRevolution = stepsPerRevolution;
+    m_homeDec            = homeDec;
+    m_sinLat             = std::sin(latitude * DEGREES);
+    m_cosLat             = std::cos(latitude * DEGREES);
+}
+
+void PointingTerms::basis(double h, double d, double sinLat, double cosLat,
+                          double rowH[TERM_COUNT], double rowD[TERM_COUNT])
+{
+    double sinH = std::sin(h * DEGREES);
+    double cosH = std::cos(h * DEGREES);
+    double sinD = std::sin(d * DEGREES);
+    double cosD = std::cos(d * DEGREES);
+
+    if (std::fabs(cosD) < MIN_COS_DEC)
+        cosD = std::copysign(MIN_COS_DEC, cosD);
+
+    double secD = 1 / cosD;
+    double tanD = sinD * secD;
+
+    rowH[IH] = 1;
+    rowH[ID] = 0;
+    rowH[CH] = secD;
+    rowH[NP] = tanD;
+    rowH[MA] = -cosH * tanD;
+    rowH[ME] = sinH * tanD;
+    rowH[TF] = cosLat * sinH * secD;
+
+    rowD[IH] = 0;
+    rowD[ID] = 1;
+    rowD[CH] = 0;
+    rowD[NP] = 0;
+    rowD[MA] = sinH;
+    rowD[ME] = cosH;
+    rowD[TF] = cosLat * cosH * sinD - sinLat * cosD;
+}
+
+uint32_t PointingTerms::wrap(int64_t steps) const
+{
+    int64_t revolution = m_stepsPerRevolution;
+    return static_cast<uint32_t>(((steps % revolution) + revolution) % revolution);
+}
+
+void PointingTerms::mechanical(uint32_t raSteps, uint32_t decSteps, double &h, double &d) const
+{
+    // Dec steps count away from the pole on the east side, and the mechanical d counts down from
+    // 90 there; on the west side the steps go the other way and d carries on past 90.
+    int64_t fromHome = wrap(int64_t(decSteps) - m_homeDec);
+    if (fromHome >= m_stepsPerRevolution / 2)
+        fromHome -= m_stepsPerRevolution;
+
+    h = wrap(raSteps) * 360.0 / m_stepsPerRevolution;
+    d = 90.0 - fromHome * 360.0 / m_stepsPerRevolution;
+}
+
+void PointingTerms::offsets(uint32_t raSteps, uint32_t decSteps, int64_t &dRA,
+                            int64_t &dDec) const
+{
+    double h, d, rowH[TERM_COUNT], rowD[TERM_COUNT];
+    mechanical(raSteps, decSteps, h, d);
+    basis(h, d, m_sinLat, m_cosLat, rowH, rowD);
+
+    double dh = 0, dd = 0;
+    for (int i = 0; i < TERM_COUNT; i++)
+    {
+        dh += m_coefficients[i] * rowH[i];
+        dd += m_coefficients[i] * rowD[i];
+    }
+
+    double stepsPerDegree = m_stepsPerRevolution / 360.0;
+    dRA                   = std::llround(dh * stepsPerDegree);
+    dDec                  = std::llround(dd * stepsPerDegree);
+}
+
+void PointingTerms::toIdeal(uint32_t &raSteps, uint32_t &decSteps) const
+{
+    if (!m_active)
+        return;
+
+    int64_t dRA, dDec;
+    offsets(raSteps, decSteps, dRA, dDec);
+
+    // d runs against the Dec steps.
+    raSteps  = wrap(raSteps - dRA);
+    decSteps = wrap(decSteps + dDec);
+}
+
+void PointingTerms::toEncoder(uint32_t &raSteps, uint32_t &decSteps) const
+{
+    if (!m_active)
+        return;
+
+    // The terms are evaluated where the encoders end up. They barely change over the few arc
+    // minutes they move things, so twice round is plenty.
+    uint32_t ra  = raSteps;
+    uint32_t dec = decSteps;
+
+    for (int i = 0; i < 2; i++)
+    {
+        int64_t dRA, dDec;
+        offsets(ra, dec, dRA, dDec);
+
+        ra  = wrap(raSteps + dRA);
+        dec = wrap(decSteps - dDec);
+    }
+
+    raSteps  = ra;
+    decSteps = dec;
+}
+
+PointingModel::PointingModel(uint32_t stepsPerRevolution, uint32_t homeDec)
+{
+    m_stepsPerRevolution = stepsPerRevolution;
+    m_homeDec            = homeDec;
+}
+
+PointingModel::~PointingModel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void PointingModel::setLatitude(double latitude)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_latitude = latitude;
+    if (m_count > 0)
+        request();
+}
+
+void PointingModel::addPoint(double hourAngle, double dec, uint32_t raSteps, uint32_t decSteps)
+{
+    PointingTerms geometry(m_stepsPerRevolution, m_homeDec, 0);
+
+    Point point;
+    geometry.mechanical(raSteps, decSteps, point.encoderH, point.encoderD);
+
+    // The side of the pier comes from the encoders; the target is put on the same side.
+    if (point.encoderD > 90.0)
+    {
+        point.idealH = hourAngle * 15.0 + 180.0;
+        point.idealD = 180.0 - dec;
+    }
+    else
+    {
+        point.idealH = hourAngle * 15.0;
+        point.idealD = dec;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_points[m_next] = point;
+    m_next           = (m_next + 1) % MAX_POINTS;
+    if (m_count < MAX_POINTS)
+        m_count++;
+
+    if (!m_thread.joinable())
+        m_thread = std::thread(&PointingModel::run, this);
+
+    request();
+}
+
+void PointingModel::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_count = 0;
+    m_next  = 0;
+    request();
+}
+
+void PointingModel::request()
+{
+    m_generation++;
+    m_pending = true;
+    m_wake.notify_one();
+}
+
+bool PointingModel::collect(PointingTerms &terms, double &rms)
+{
+    if (!m_ready.load(std::memory_order_acquire))
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    terms = m_fitted;
+    rms   = m_rms;
+    m_ready.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+void PointingModel::run()
+{
+    // A singular fit is an answer to report, not a reason to abort the driver.
+    gsl_set_error_handler_off();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_pending || m_stopping; });
+        if (m_stopping)
+            return;
+
+        Point points[MAX_POINTS];
+        size_t count        = m_count;
+        double latitude     = m_latitude;
+        uint64_t generation = m_generation;
+        std::copy(m_points, m_points + count, points);
+        m_pending = false;
+
+        lock.unlock();
+
+        PointingTerms terms;
+        double rms  = 0;
+        bool fitted = count == 0 || fit(points, count, latitude, terms, rms);
+
+        lock.lock();
+
+        if (fitted && generation == m_generation)
+        {
+            m_fitted = terms;
+            m_rms    = rms;
+            m_ready.store(true, std::memory_order_release);
+        }
+    }
+}
+
+bool PointingModel::fit(const Point *points, size_t count, double latitude, PointingTerms &terms,
+                        double &rms) const
+{
+    size_t rows = 2 * count;
+    // At least two equations for every term, so noise in a few points can't run away with them.
+    size_t used = std::min<size_t>(PointingTerms::TERM_COUNT, std::max<size_t>(2, count));
+
+    gsl_matrix *x                       = gsl_matrix_alloc(rows, used);
+    gsl_vector *y                       = gsl_vector_alloc(rows);
+    gsl_vector *w                       = gsl_vector_alloc(rows);
+    gsl_vector *c                       = gsl_vector_alloc(used);
+    gsl_matrix *cov                     = gsl_matrix_alloc(used, used);
+    gsl_multifit_linear_workspace *work = gsl_multifit_linear_alloc(rows, used);
+
+    double sinLat = std::sin(latitude * DEGREES);
+    double cosLat = std::cos(latitude * DEGREES);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Point &p = points[i];
+        double rowH[PointingTerms::TERM_COUNT], rowD[PointingTerms::TERM_COUNT];
+        PointingTerms::basis(p.encoderH, p.encoderD, sinLat, cosLat, rowH, rowD);
+
+        for (size_t k = 0; k < used; k++)
+        {
+            gsl_matrix_set(x, 2 * i, k, rowH[k]);
+            gsl_matrix_set(x, 2 * i + 1, k, rowD[k]);
+        }
+
+        double cosD = std::cos(p.encoderD * DEGREES);
+
+        gsl_vector_set(y, 2 * i, wrap180(p.encoderH - p.idealH));
+        gsl_vector_set(y, 2 * i + 1, p.encoderD - p.idealD);
+        gsl_vector_set(w, 2 * i, cosD * cosD);
+        gsl_vector_set(w, 2 * i + 1, 1);
+    }
+
+    double chisq;
+    bool ok = gsl_multifit_wlinear(x, w, y, c, cov, &chisq, work) == GSL_SUCCESS;
+
+    if (ok)
+    {
+        terms = PointingTerms(m_stepsPerRevolution, m_homeDec, latitude);
+        for (size_t k = 0; k < used; k++)
+            terms.set(static_cast<int>(k), gsl_vector_get(c, k));
+        rms = std::sqrt(chisq / rows);
+    }
+
+    gsl_multifit_linear_free(work);
+    gsl_matrix_free(cov);
+    gsl_vector_free(c);
+    gsl_vector_free(w);
+    gsl_vector_free(y);
+    gsl_matrix_free(x);
+
+    return ok;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+/*
+The fitted pointing model, as the alignment applies it to every conversion.
+
+The terms are the usual ones for a German equatorial mount, in the mount's mechanical frame:
+hour angle h straight off the RA encoder, and declination d running past the pole to 180 degrees
+on the far side of the pier. Working there, the terms change sign across the meridian by
+themselves, as the errors they stand for do. In degrees, the encoders read the ideal position plus
+
+    dh = IH + CH sec d + NP tan d - MA cos h tan d + ME sin h tan d + TF cos lat sin h sec d
+    dd = ID + MA sin h + ME cos h + TF (cos lat cos h sin d - sin lat cos d)
+
+IH and ID are the index offsets, CH the cone error, NP the non-perpendicularity of the axes, MA and
+ME the polar axis off to the east and down, and TF the tube flexure.
+
+Applying them is a handful of multiplies and one sine and cosine per axis. A default-constructed
+set is inactive and leaves the steps alone, so without a model every conversion stays exact.
+*/
+class PointingTerms
+{
+  public:
+    enum Term
+    {
+        IH,
+        ID,
+        CH,
+        NP,
+        MA,
+        ME,
+        TF,
+        TERM_COUNT
+    };
+
+    PointingTerms();
+    PointingTerms(uint32_t stepsPerRevolution, uint32_t homeDec, double latitude);
+
+    bool active() const
+    {
+        return m_active;
+    }
+    double operator[](int term) const
+    {
+        return m_coefficients[term];
+    }
+    void set(int term, double degrees)
+    {
+        m_coefficients[term] = degrees;
+        m_active             = true;
+    }
+
+    // What each term adds to dh and dd at a mechanical position, per degree of the term. The fit
+    // uses these too, so it can't disagree with what gets applied.
+    static void basis(double h, double d, double sinLat, double cosLat, double rowH[TERM_COUNT],
+                      double rowD[TERM_COUNT]);
+
+    // Mechanical position of a pair of encoder counts, in degrees.
+    void mechanical(uint32_t raSteps, uint32_t decSteps, double &h, double &d) const;
+
+    // Encoder counts to where they would be on a perfect mount, and back.
+    void toIdeal(uint32_t &raSteps, uint32_t &decSteps) const;
+    void toEncoder(uint32_t &raSteps, uint32_t &decSteps) const;
+
+  private:
+    uint32_t wrap(int64_t steps) const;
+    void offsets(uint32_t raSteps, uint32_t decSteps, int64_t &dRA, int64_t &dDec) const;
+
+    bool m_active{false};
+    double m_coefficients[TERM_COUNT];
+    uint32_t m_stepsPerRevolution{0};
+    uint32_t m_homeDec{0};
+    double m_sinLat{0};
+    double m_cosLat{1};
+};
+
+/*
+Collects sync points and fits PointingTerms to them by weighted least squares, with GSL.
+
+A sync point is where the mount's encoders were when it was looking at a known hour angle and
+declination. Each one gives two equations in the terms. The hour angle rows are weighted by cos^2
+d, so both rows count errors as arcs on the sky and points near the pole don't swamp the rest.
+Terms are brought in one per point, IH and ID first and TF last, so a few points give a rough fit
+rather than a wild one.
+
+Fitting runs on a worker thread, started with the first point. Each addPoint() or clear() asks for
+a fresh fit; collect() hands the latest one over on the caller's thread, so the alignment's terms
+are only ever touched there.
+*/
+class PointingModel
+{
+  public:
+    static const size_t MAX_POINTS = 32;
+
+    PointingModel(uint32_t stepsPerRevolution, uint32_t homeDec);
+    ~PointingModel();
+
+    void setLatitude(double latitude);
+
+    // The oldest point goes once there are MAX_POINTS.
+    void addPoint(double hourAngle, double dec, uint32_t raSteps, uint32_t decSteps);
+    void clear();
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    // True and the newest fit, if there is one the caller hasn't had. rms is the fit's residual
+    // on the sky, in degrees.
+    bool collect(PointingTerms &terms, double &rms);
+
+  private:
+    struct Point
+    {
+        // Mechanical positions in degrees: where the target is, and where the encoders were.
+        double idealH;
+        double idealD;
+        double encoderH;
+        double encoderD;
+    };
+
+    void run();
+    bool fit(const Point *points, size_t count, double latitude, PointingTerms &terms,
+             double &rms) const;
+    void request();
+
+    uint32_t m_stepsPerRevolution;
+    uint32_t m_homeDec;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+
+    // Under m_mutex.
+    Point m_points[MAX_POINTS];
+    size_t m_count{0};
+    size_t m_next{0};
+    double m_latitude{0};
+    bool m_pending{false};
+    bool m_stopping{false};
+    // Bumped by every request; a fit started before the latest one is thrown away.
+    uint64_t m_generation{0};
+    PointingTerms m_fitted;
+    double m_rms{0};
+
+    std::atomic<bool> m_ready{false};
+};
@@ -0,0 +1,112 @@
+#include "pollscheduler.h"
+
+// Interval in ms between polls of a query in each mount state. 0 polls every cycle, NEVER only
+// polls after the cached value was invalidated. While tracking, the driver extrapolates the
+// encoders in between and invalidates the position whenever the extrapolation can't be trusted.
+static const int NEVER = -1;
+
+static const int POLL_INTERVALS[PollScheduler::MOUNT_STATE_COUNT][PollScheduler::QUERY_COUNT] = {
+    // POSITION, AUTOGUIDE_RATE, SLEW_DONE, GUIDE_ACTIVE, LEVEL_DONE
+    { 5000, NEVER, NEVER, NEVER, NEVER }, // PARKED
+    { 1000, NEVER, NEVER, NEVER, NEVER }, // IDLE
+    { 2000, NEVER, NEVER, NEVER, NEVER }, // TRACKING
+    { 0, NEVER, 0, NEVER, NEVER },        // SLEWING
+    { 0, NEVER, NEVER, 0, NEVER },        // GUIDING
+    { 500, NEVER, NEVER, NEVER, 0 },      // HOMING
+};
+
+// Bytes on the wire per axis for each query: a 6 byte request plus a reply carrying this many
+// data bytes on top of its own 6 bytes of framing.
+static const int REPLY_DATA_SIZE[PollScheduler::QUERY_COUNT] = { 3, 1, 1, 1, 1 };
+
+PollScheduler::PollScheduler()
+{
+    m_stateSince = Clock::now();
+
+    for (int i = 0; i < QUERY_COUNT; i++)
+    {
+        m_lastPolled[i] = Clock::time_point();
+        m_invalid[i]    = false;
+    }
+
+    // Nothing is cached yet.
+    m_invalid[POLL_AUTOGUIDE_RATE] = true;
+
+    for (int i = 0; i < MOUNT_STATE_COUNT; i++)
+    {
+        m_bytes[i]   = 0;
+        m_seconds[i] = 0;
+    }
+}
+
+void PollScheduler::setState(MountState state, Clock::time_point now)
+{
+    if (state == m_state)
+        return;
+
+    m_seconds[m_state] += std::chrono::duration<double>(now - m_stateSince).count();
+    m_state      = state;
+    m_stateSince = now;
+
+    // Start the new state with a fresh look at everything it cares about.
+    for (int i = 0; i < QUERY_COUNT; i++)
+        m_lastPolled[i] = Clock::time_point();
+}
+
+bool PollScheduler::due(Query query, Clock::time_point now) const
+{
+    if (m_invalid[query])
+        return true;
+
+    int interval = POLL_INTERVALS[m_state][query];
+    if (interval == NEVER)
+        return false;
+
+    int elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastPolled[query]).count();
+
+    return m_lastPolled[query] == Clock::time_point() ||
+           elapsed + static_cast<int>(m_toleranceMs) >= interval;
+}
+
+void PollScheduler::polled(Query query, int axes, Clock::time_point now)
+{
+    m_lastPolled[query] = now;
+    m_invalid[query]    = false;
+    m_bytes[m_state] += axes * (6 + 6 + REPLY_DATA_SIZE[query]);
+}
+
+void PollScheduler::invalidate(Query query)
+{
+    m_invalid[query] = true;
+}
+
+double PollScheduler::bytesPerSecond(MountState state, Clock::time_point now) const
+{
+    double seconds = m_seconds[state];
+    if (state == m_state)
+        seconds += std::chrono::duration<double>(now - m_stateSince).count();
+
+    return seconds > 0 ? m_bytes[state] / seconds : 0;
+}
+
+const char *PollScheduler::stateName(MountState state)
+{
+    switch (state)
+    {
+    case MOUNT_PARKED:
+        return "Parked";
+    case MOUNT_IDLE:
+        return "Idle";
+    case MOUNT_TRACKING:
+        return "Tracking";
+    case MOUNT_SLEWING:
+        return "Slewing";
+    case MOUNT_GUIDING:
+        return "Guiding";
+    case MOUNT_HOMING:
+        return "Homing";
+    default:
+        return "Unknown";
+    }
+}
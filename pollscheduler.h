@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Decides which status queries ReadScopeStatus puts on the bus each cycle.
+
+Every query has an interval per mount state: some go out every cycle, some every few seconds and
+some never. Values that only change when we change them, like the autoguide rate, are cached and
+only fetched again after invalidate(). The scheduler also keeps track of how many bytes the polls
+cost in each state, so the bus load of e.g. a night of guiding can be read off directly.
+*/
+class PollScheduler
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum MountState
+    {
+        MOUNT_PARKED,
+        MOUNT_IDLE,
+        MOUNT_TRACKING,
+        MOUNT_SLEWING,
+        MOUNT_GUIDING,
+        MOUNT_HOMING,
+        MOUNT_STATE_COUNT
+    };
+
+    enum Query
+    {
+        POLL_POSITION,
+        POLL_AUTOGUIDE_RATE,
+        POLL_SLEW_DONE,
+        POLL_GUIDE_ACTIVE,
+        POLL_LEVEL_DONE,
+        QUERY_COUNT
+    };
+
+    PollScheduler();
+
+    void setState(MountState state, Clock::time_point now);
+    MountState state() const
+    {
+        return m_state;
+    }
+
+    // Polls are due a little early rather than a whole cycle late.
+    void setTolerance(uint32_t ms)
+    {
+        m_toleranceMs = ms;
+    }
+
+    bool due(Query query, Clock::time_point now) const;
+    // Records that the query went out to the given number of axes.
+    void polled(Query query, int axes, Clock::time_point now);
+    // The cached value is stale, so poll it on the next cycle whatever the state.
+    void invalidate(Query query);
+
+    double bytesPerSecond(MountState state, Clock::time_point now) const;
+
+    static const char *stateName(MountState state);
+
+  private:
+    MountState m_state{MOUNT_IDLE};
+    Clock::time_point m_stateSince;
+    uint32_t m_toleranceMs{0};
+
+    Clock::time_point m_lastPolled[QUERY_COUNT];
+    bool m_invalid[QUERY_COUNT];
+
+    uint64_t m_bytes[MOUNT_STATE_COUNT];
+    double m_seconds[MOUNT_STATE_COUNT];
+};
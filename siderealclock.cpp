@@ -0,0 +1,44 @@
+#include "siderealclock.h"
+
+#include <cmath>
+
+#include <libindi/indicom.h>
+#include <libnova/sidereal_time.h>
+
+const int SiderealClock::REANCHOR_SECONDS;
+
+// Sidereal hours per SI hour.
+static const double SIDEREAL_RATE = 1.00273790935;
+
+void SiderealClock::setLongitude(double longitude)
+{
+    m_longitude = longitude;
+    m_anchored  = false;
+}
+
+double SiderealClock::localSiderealTime(Clock::time_point now)
+{
+    if (!m_anchored || now - m_anchorTime >= std::chrono::seconds(REANCHOR_SECONDS))
+    {
+        anchor(now);
+    }
+
+    double hours = std::chrono::duration<double>(now - m_anchorTime).count() / 3600.0;
+    double lst   = std::fmod(m_anchorLST + hours * SIDEREAL_RATE, 24.0);
+
+    return lst < 0 ? lst + 24.0 : lst;
+}
+
+double SiderealClock::localSiderealTimeAt(double julianDate) const
+{
+    double lst = std::fmod(ln_get_apparent_sidereal_time(julianDate) + m_longitude / 15.0, 24.0);
+
+    return lst < 0 ? lst + 24.0 : lst;
+}
+
+void SiderealClock::anchor(Clock::time_point now)
+{
+    m_anchorLST  = get_local_sidereal_time(m_longitude);
+    m_anchorTime = now;
+    m_anchored   = true;
+}
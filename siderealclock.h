@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+
+/*
+Local sidereal time without a Julian date calculation on every call.
+
+The clock takes one reading from libnova as an anchor and from then on advances from the monotonic
+clock at the sidereal rate. It re-anchors every REANCHOR_SECONDS, so a wall clock step (e.g. NTP
+catching up) is picked up within that time, and whenever the longitude changes.
+
+Between hold() and release() the clock stands still, so everything computed in one poll cycle
+agrees.
+*/
+class SiderealClock
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int REANCHOR_SECONDS = 60;
+
+    void setLongitude(double longitude);
+
+    double localSiderealTime()
+    {
+        return m_held ? m_heldLST : localSiderealTime(Clock::now());
+    }
+    double localSiderealTime(Clock::time_point now);
+    // Straight from libnova, for any instant.
+    double localSiderealTimeAt(double julianDate) const;
+
+    void hold()
+    {
+        m_heldLST = localSiderealTime(Clock::now());
+        m_held    = true;
+    }
+    void release()
+    {
+        m_held = false;
+    }
+
+  private:
+    void anchor(Clock::time_point now);
+
+    double m_longitude{0};
+    bool m_anchored{false};
+    double m_anchorLST{0};
+    Clock::time_point m_anchorTime;
+
+    bool m_held{false};
+    double m_heldLST{0};
+};
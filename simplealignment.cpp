@@ -1,7 +1,22 @@
 #include <libindi/indicom.h>
 
+#include <cmath>
+
 #include "simplealignment.h"
 
+// Inlined equivalents of get_local_hour_angle and range24, so the batch loops don't call out.
+static inline double hourAngleOf(double lst, double ra)
+{
+    double hourAngle = lst - ra;
+    return hourAngle >= 12.0 ? hourAngle - 24.0 : hourAngle <= -12.0 ? hourAngle + 24.0 : hourAngle;
+}
+
+static inline double wrap24(double hours)
+{
+    hours = std::fmod(hours, 24.0);
+    return hours < 0 ? hours + 24.0 : hours;
+}
+
 EQAlignment::EQAlignment(uint32_t stepsPerRevolution)
 {
     m_stepsPerRevolution     = stepsPerRevolution;
@@ -30,6 +45,7 @@ void EQAlignment::UpdateStepsDec(uint32_t steps)
 void EQAlignment::UpdateLongitude(double lng)
 {
     m_longitude = lng;
+    m_clock.setLongitude(lng);
 }
 
 EQAlignment::TelescopePierSide EQAlignment::expectedPierSide(double ra)
@@ -42,19 +58,17 @@ EQAlignment::TelescopePierSide EQAlignment::expectedPierSide(double ra)
 void EQAlignment::EncoderValuesFromRADec(double ra, double dec, uint32_t &raSteps,
                                          uint32_t &decSteps, TelescopePierSide &pierSide)
 {
-    pierSide = expectedPierSide(ra);
-
-    // Inverse of RADecFromEncoderValues
-    double lst       = localSiderealTime();
-    double hourAngle = lst - ra;
+    EncoderValuesFromRADec(localSiderealTime(), 1, &ra, &dec, &raSteps, &decSteps, &pierSide);
+}
 
-    if (pierSide == PIER_WEST)
-    {
-        hourAngle += 12.0;
-    }
+void EQAlignment::EncoderValuesFromRADec(double ra, double dec, TelescopePierSide pierSide,
+                                         uint32_t &raSteps, uint32_t &decSteps)
+{
+    double hourAngle = hourAngleOf(localSiderealTime(), ra);
 
-    raSteps  = encoderFromHourAngle(hourAngle);
+    raSteps  = encoderFromHourAngle(wrap24(hourAngle + (pierSide == PIER_WEST ? 12.0 : 0.0)));
     decSteps = encoderFromDecAndPierSide(dec, pierSide);
+    m_terms.toEncoder(raSteps, decSteps);
 }
 
 double EQAlignment::hourAngleFromEncoder()
@@ -123,22 +137,92 @@ void EQAlignment::decAndPierSideFromEncoder(double &dec, TelescopePierSide &pier
 
 void EQAlignment::RADecFromEncoderValues(double &ra, double &dec, TelescopePierSide &pierSide)
 {
-    double hourAngle = hourAngleFromEncoder();
-    double lst       = localSiderealTime();
-    ra               = lst - hourAngle;
+    RADecFromEncoderValues(localSiderealTime(), 1, &m_raSteps, &m_decSteps, &ra, &dec, &pierSide);
+}
 
-    decAndPierSideFromEncoder(dec, pierSide);
+void EQAlignment::EncoderValuesFromRADec(double lst, size_t count, const double *ra,
+                                         const double *dec, uint32_t *raSteps, uint32_t *decSteps,
+                                         TelescopePierSide *pierSide) const
+{
+    const double home    = m_stepsAtHomePositionRA;
+    const double decHome = m_stepsAtHomePositionDec;
 
-    if (pierSide == PIER_WEST)
+    for (size_t i = 0; i < count; i++)
+    {
+        double hourAngle = hourAngleOf(lst, ra[i]);
+        bool west        = hourAngle <= 0;
+
+        if (west)
+        {
+            hourAngle += 12.0;
+        }
+
+        // The hour angle is wrapped first, so this can't go negative.
+        int64_t steps = static_cast<int64_t>(home + (hourAngle - 6.0) * m_stepsPerHour);
+        raSteps[i]    = static_cast<uint32_t>(steps % m_stepsPerRevolution);
+
+        double offset = static_cast<uint32_t>((90.0 - dec[i]) * m_stepsPerDegree);
+        decSteps[i]   = static_cast<uint32_t>(west ? decHome - offset : decHome + offset);
+        pierSide[i]   = west ? PIER_WEST : PIER_EAST;
+    }
+
+    // Apart, so the loop above still vectorizes.
+    if (m_terms.active())
     {
-        ra = ra - 12.0;
+        for (size_t i = 0; i < count; i++)
+            m_terms.toEncoder(raSteps[i], decSteps[i]);
     }
+}
 
-    ra  = range24(ra);
-    dec = rangeDec(dec);
+void EQAlignment::RADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                         const uint32_t *decSteps, double *ra, double *dec,
+                                         TelescopePierSide *pierSide) const
+{
+    if (!m_terms.active())
+    {
+        idealRADecFromEncoderValues(lst, count, raSteps, decSteps, ra, dec, pierSide);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t raIdeal  = raSteps[i];
+        uint32_t decIdeal = decSteps[i];
+        m_terms.toIdeal(raIdeal, decIdeal);
+        idealRADecFromEncoderValues(lst, 1, &raIdeal, &decIdeal, &ra[i], &dec[i], &pierSide[i]);
+    }
+}
+
+void EQAlignment::idealRADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                              const uint32_t *decSteps, double *ra, double *dec,
+                                              TelescopePierSide *pierSide) const
+{
+    const double home    = m_stepsAtHomePositionRA;
+    const double decHome = m_stepsAtHomePositionDec;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double hourAngle = 6.0 + (raSteps[i] - home) / m_stepsPerHour;
+        bool west        = decSteps[i] <= m_stepsAtHomePositionDec;
+
+        double r = lst - hourAngle;
+        if (west)
+        {
+            r -= 12.0;
+        }
+
+        ra[i]       = wrap24(r);
+        dec[i]      = 90.0 - std::fabs(decSteps[i] - decHome) / m_stepsPerDegree;
+        pierSide[i] = west ? PIER_WEST : PIER_EAST;
+    }
 }
 
 double EQAlignment::localSiderealTime()
 {
-    return get_local_sidereal_time(m_longitude);
+    return m_clock.localSiderealTime();
+}
+
+double EQAlignment::localSiderealTime(double julianDate) const
+{
+    return m_clock.localSiderealTimeAt(julianDate);
 }
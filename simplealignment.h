@@ -1,12 +1,24 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "pointingmodel.h"
+#include "siderealclock.h"
+
 /*
 Simple class to map steps on a motor to RA/Dec and back on an EQ mount.
 
 Call UpdateSteps before using RADecFromEncoderValues. Or call EncoderValuesFromRADec to get
 the steps for a given RA/Dec.
+
+The batch overloads convert whole arrays for a given sidereal time and leave the live encoder
+state alone, for planning and model fitting. Inputs and outputs are separate arrays rather than
+arrays of points, so the loops stay simple enough for the compiler to vectorize.
+
+Between holdTime() and releaseTime() every conversion uses the same sidereal time.
+
+RA/Dec conversions go through the pointing terms once there are some.
 */
 class EQAlignment
 {
@@ -24,12 +36,27 @@ class EQAlignment
     void UpdateStepsRA(uint32_t steps);
     void UpdateStepsDec(uint32_t steps);
     void UpdateLongitude(double lng);
+    void setPointingTerms(const PointingTerms &terms)
+    {
+        m_terms = terms;
+    }
 
     void EncoderValuesFromRADec(double ra, double dec, uint32_t &raSteps, uint32_t &decSteps,
                                 TelescopePierSide &pierSide);
 
+    // The same, from the given side of the pier whatever the hour angle says.
+    void EncoderValuesFromRADec(double ra, double dec, TelescopePierSide pierSide,
+                                uint32_t &raSteps, uint32_t &decSteps);
+
     void RADecFromEncoderValues(double &ra, double &dec, TelescopePierSide &pierSide);
 
+    void EncoderValuesFromRADec(double lst, size_t count, const double *ra, const double *dec,
+                                uint32_t *raSteps, uint32_t *decSteps,
+                                TelescopePierSide *pierSide) const;
+    void RADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                const uint32_t *decSteps, double *ra, double *dec,
+                                TelescopePierSide *pierSide) const;
+
     double hourAngleFromEncoder();
     uint32_t encoderFromHourAngle(double hourAngle);
 
@@ -37,6 +64,16 @@ class EQAlignment
     uint32_t encoderFromDecAndPierSide(double dec, TelescopePierSide pierSide);
 
     double localSiderealTime();
+    double localSiderealTime(double julianDate) const;
+
+    void holdTime()
+    {
+        m_clock.hold();
+    }
+    void releaseTime()
+    {
+        m_clock.release();
+    }
 
     TelescopePierSide expectedPierSide(double ra);
 
@@ -50,6 +87,10 @@ class EQAlignment
     }
 
   private:
+    void idealRADecFromEncoderValues(double lst, size_t count, const uint32_t *raSteps,
+                                     const uint32_t *decSteps, double *ra, double *dec,
+                                     TelescopePierSide *pierSide) const;
+
     uint32_t m_stepsPerRevolution;
     uint32_t m_stepsAtHomePositionDec;
     uint32_t m_stepsAtHomePositionRA;
@@ -60,4 +101,7 @@ class EQAlignment
     uint32_t m_decSteps;
 
     double m_longitude;
+
+    SiderealClock m_clock;
+    PointingTerms m_terms;
 };
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "slewmodel.h"
+
+#include <cmath>
+
+const int SlewModel::AXES;
+
+// How far each finished leg moves the figures towards what it measured.
+static const double WEIGHT = 0.25;
+// Closer together than this, the steps between two readings are mostly timing noise.
+static const double MIN_SAMPLE_SECONDS = 0.1;
+// Two speeds this close are the same cruise.
+static const double CRUISE_TOLERANCE = 0.03;
+
+static double blend(double old, double measured)
+{
+    return old + WEIGHT * (measured - old);
+}
+
+SlewModel::SlewModel(uint32_t stepsPerRevolution)
+{
+    m_stepsPerRevolution  = stepsPerRevolution;
+    double stepsPerDegree = stepsPerRevolution / 360.0;
+
+    for (int i = 0; i < AXES; i++)
+    {
+        m_axes[i].acceleration = 2.0 * stepsPerDegree;
+        m_axes[i].fastRate     = 4.0 * stepsPerDegree;
+        m_axes[i].slowRate     = 0.5 * stepsPerDegree;
+        m_axes[i].approach     = 2.0;
+    }
+
+    cancel();
+}
+
+double SlewModel::seconds(int axis, double steps, bool fast) const
+{
+    const Axis &a = m_axes[axis];
+    double rate   = fast ? a.fastRate : a.slowRate;
+    double d      = std::fabs(steps);
+
+    // Speeding up to the top rate and back down again covers rate^2 / acceleration.
+    if (d * a.acceleration >= rate * rate)
+        return d / rate + rate / a.acceleration;
+
+    return 2 * std::sqrt(d / a.acceleration);
+}
+
+double SlewModel::seconds(double raSteps, double decSteps, bool fast) const
+{
+    double ra  = seconds(0, raSteps, fast);
+    double dec = seconds(1, decSteps, fast);
+
+    return ra > dec ? ra : dec;
+}
+
+double SlewModel::approachSeconds() const
+{
+    return m_axes[0].approach > m_axes[1].approach ? m_axes[0].approach : m_axes[1].approach;
+}
+
+void SlewModel::started(int axis, double steps, Leg leg, Clock::time_point now)
+{
+    Run &run       = m_runs[axis];
+    run.active     = true;
+    run.leg        = leg;
+    run.steps      = std::fabs(steps);
+    run.started    = now;
+    run.haveSample = false;
+    run.rate       = 0;
+    run.cruise     = 0;
+}
+
+void SlewModel::sampled(int axis, uint32_t position, Clock::time_point now)
+{
+    Run &run = m_runs[axis];
+    if (!run.active)
+        return;
+
+    if (run.haveSample)
+    {
+        double dt = std::chrono::duration<double>(now - run.sampled).count();
+        if (dt < MIN_SAMPLE_SECONDS)
+            return;
+
+        // The shorter way round; nothing covers half a turn between two polls.
+        uint32_t mask  = m_stepsPerRevolution - 1;
+        uint32_t ahead = (position - run.position) & mask;
+        double moved   = ahead > mask / 2 ? m_stepsPerRevolution - ahead : ahead;
+        double rate    = moved / dt;
+
+        if (run.rate > 0 && std::fabs(rate - run.rate) <= CRUISE_TOLERANCE * rate)
+        {
+            double cruise = (rate + run.rate) / 2;
+            if (cruise > run.cruise)
+                run.cruise = cruise;
+        }
+        run.rate = rate;
+    }
+
+    run.position   = position;
+    run.sampled    = now;
+    run.haveSample = true;
+}
+
+bool SlewModel::finished(int axis, Clock::time_point now)
+{
+    Run &run = m_runs[axis];
+    if (!run.active)
+        return false;
+
+    run.active = false;
+
+    Axis &a  = m_axes[axis];
+    double t = std::chrono::duration<double>(now - run.started).count();
+    if (t <= 0)
+        return false;
+
+    if (run.leg == LEG_APPROACH)
+    {
+        a.approach = blend(a.approach, t);
+        return true;
+    }
+
+    bool fast    = run.leg == LEG_FAST;
+    double &rate = fast ? a.fastRate : a.slowRate;
+    bool changed = false;
+
+    if (run.cruise > 0)
+    {
+        rate    = blend(rate, run.cruise);
+        changed = true;
+    }
+
+    // The slow gotos are too short to say much about the acceleration, and may not share it.
+    if (!fast || run.steps <= 0)
+        return changed;
+
+    // A leg that cruised was a trapezoid; one that didn't, a triangle. Either way the time runs
+    // to the SLEW_DONE reply, so a late poll makes the motors look a little slower than they are.
+    double acceleration = 0;
+    if (run.cruise > 0 && t > run.steps / rate)
+        acceleration = rate / (t - run.steps / rate);
+    else if (run.cruise == 0)
+        acceleration = 4 * run.steps / (t * t);
+
+    // A triangle that would have topped the rate must have cruised between two polls.
+    if (run.cruise == 0 && acceleration * run.steps > rate * rate)
+        acceleration = 0;
+
+    if (acceleration > 0 && std::isfinite(acceleration))
+    {
+        a.acceleration = blend(a.acceleration, acceleration);
+        changed        = true;
+    }
+
+    return changed;
+}
+
+void SlewModel::cancel()
+{
+    for (int i = 0; i < AXES; i++)
+        m_runs[i].active = false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+Estimates how long the motors take to get somewhere.
+
+Each axis speeds up at a constant acceleration to the top rate of the goto, cruises, and brakes
+the same way to stop on the target; a short move never gets to top speed and only speeds up and
+slows down. Both axes move at once, so a goto takes as long as the slower of the two. A fast goto
+is finished by a GOTO_SLOW approach, which the model counts as a fixed time per axis. Until told
+otherwise every axis gets the CGX's nominal figures.
+
+The model calibrates itself from the gotos the driver makes. Each leg is started() with its
+length, sampled() with every position read back while it runs, and finished() on SLEW_DONE. Two
+readings in a row at the same speed are a cruise, and the fastest cruise of a leg is the top rate.
+Knowing that, the leg's time gives the acceleration: a trapezoid takes d/v + v/a. Each leg only
+moves the figures part of the way, so one odd goto doesn't undo the rest.
+*/
+class SlewModel
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const int AXES = 2;
+
+    struct Axis
+    {
+        // Steps per second squared, and top rates in steps per second.
+        double acceleration;
+        double fastRate;
+        double slowRate;
+        // Seconds taken by the GOTO_SLOW approach that ends a fast goto.
+        double approach;
+    };
+
+    enum Leg
+    {
+        LEG_FAST,
+        LEG_SLOW,
+        // GOTO_SLOW from wherever a fast goto ended to the target.
+        LEG_APPROACH
+    };
+
+    explicit SlewModel(uint32_t stepsPerRevolution);
+
+    void setAxis(int axis, const Axis &model)
+    {
+        m_axes[axis] = model;
+    }
+    const Axis &axis(int axis) const
+    {
+        return m_axes[axis];
+    }
+
+    // From standing to standing, over steps in either direction, at GOTO_FAST or GOTO_SLOW.
+    double seconds(int axis, double steps, bool fast) const;
+    double seconds(double raSteps, double decSteps, bool fast) const;
+    // The slower axis' approach.
+    double approachSeconds() const;
+
+    void started(int axis, double steps, Leg leg, Clock::time_point now);
+    void sampled(int axis, uint32_t position, Clock::time_point now);
+    // Returns true if the figures for the axis changed.
+    bool finished(int axis, Clock::time_point now);
+    // The legs under way were interrupted and say nothing about the motors.
+    void cancel();
+
+  private:
+    struct Run
+    {
+        bool active;
+        Leg leg;
+        double steps;
+        Clock::time_point started;
+        uint32_t position;
+        Clock::time_point sampled;
+        bool haveSample;
+        double rate;
+        double cruise;
+    };
+
+    uint32_t m_stepsPerRevolution;
+    Axis m_axes[AXES];
+    Run m_runs[AXES];
+};
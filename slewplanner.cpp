@@ -0,0 +1,67 @@
+#include "slewplanner.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+const size_t SlewPlanner::MAX_WAYPOINTS;
+
+SlewPlanner::SlewPlanner(uint32_t stepsPerRevolution, uint32_t homeRA, uint32_t homeDec)
+{
+    m_stepsPerRevolution = stepsPerRevolution;
+    m_homeRA             = homeRA;
+    m_homeDec            = homeDec;
+    // A quarter turn, well short of the half where the motor would turn the other way.
+    m_maxLeg = stepsPerRevolution / 4;
+    // Opposite home, i.e. counterweight straight up, until the driver sets the real one.
+    m_cordwrap = wrap(int64_t(homeRA) + stepsPerRevolution / 2);
+    // 15 degrees.
+    m_counterweightLimit = stepsPerRevolution / 24;
+}
+
+int64_t SlewPlanner::fromHome(uint32_t steps, uint32_t home) const
+{
+    int64_t half     = m_stepsPerRevolution / 2;
+    int64_t distance = wrap(int64_t(steps) - home);
+
+    return distance > half ? distance - m_stepsPerRevolution : distance;
+}
+
+uint32_t SlewPlanner::wrap(int64_t steps) const
+{
+    return static_cast<uint32_t>(steps) & (m_stepsPerRevolution - 1);
+}
+
+bool SlewPlanner::plan(uint32_t fromRA, uint32_t fromDec, uint32_t toRA, uint32_t toDec)
+{
+    m_count = 0;
+
+    int64_t ra0  = fromHome(fromRA, m_homeRA);
+    int64_t ra1  = fromHome(toRA, m_homeRA);
+    int64_t dec0 = fromHome(fromDec, m_homeDec);
+    int64_t dec1 = fromHome(toDec, m_homeDec);
+
+    // The counterweight is horizontal a quarter turn either side of home.
+    if (std::llabs(ra1) > int64_t(m_stepsPerRevolution / 4 + m_counterweightLimit))
+        return false;
+
+    // Touching the cordwrap position is as bad as going through it.
+    int64_t cordwrap = fromHome(m_cordwrap, m_homeRA);
+    if ((ra0 <= cordwrap && cordwrap <= ra1) || (ra1 <= cordwrap && cordwrap <= ra0))
+        return false;
+
+    int64_t longest = std::max(std::llabs(ra1 - ra0), std::llabs(dec1 - dec0));
+    int64_t legs    = (longest + m_maxLeg - 1) / m_maxLeg;
+    if (legs < 1)
+        legs = 1;
+    if (legs > int64_t(MAX_WAYPOINTS))
+        return false;
+
+    for (int64_t i = 1; i <= legs; i++)
+    {
+        Waypoint &waypoint = m_waypoints[m_count++];
+        waypoint.ra        = wrap(m_homeRA + ra0 + (ra1 - ra0) * i / legs);
+        waypoint.dec       = wrap(m_homeDec + dec0 + (dec1 - dec0) * i / legs);
+    }
+
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Plans gotos in encoder space, so the mount can cross the meridian without searching for its index
+again.
+
+A motor told to go somewhere takes the shortest way round its own encoder circle. Between two
+positions more than half a turn apart that is the wrong way: through counterweight up on RA, or
+under the mount on Dec. The planner measures both axes from home (counterweight down, pointing at
+the pole), where the way the mount should go is simply a straight line, and cuts that line into
+legs of at most MAX_LEG steps per axis. Each leg is then short enough that the motor's shortest way
+is the planned one. A pier flip passes through home on both axes along the way, as it did when the
+driver searched for the index in between.
+
+A plan is refused if the target raises the counterweight further above horizontal than the limit,
+or if the RA leg would run through the cordwrap position, where the motor controller won't go.
+*/
+class SlewPlanner
+{
+  public:
+    static const size_t MAX_WAYPOINTS = 8;
+
+    struct Waypoint
+    {
+        uint32_t ra;
+        uint32_t dec;
+    };
+
+    SlewPlanner(uint32_t stepsPerRevolution, uint32_t homeRA, uint32_t homeDec);
+
+    void setCordwrap(uint32_t raSteps)
+    {
+        m_cordwrap = raSteps;
+    }
+    // How far past horizontal the counterweight may rise at the target.
+    void setCounterweightLimit(uint32_t steps)
+    {
+        m_counterweightLimit = steps;
+    }
+
+    // Fills the waypoints from one pair of encoder positions to another, the last one being the
+    // target itself. False if there is no safe way there.
+    bool plan(uint32_t fromRA, uint32_t fromDec, uint32_t toRA, uint32_t toDec);
+
+    size_t size() const
+    {
+        return m_count;
+    }
+    const Waypoint &operator[](size_t i) const
+    {
+        return m_waypoints[i];
+    }
+
+  private:
+    // Signed distance from home, in (-half a turn, half a turn].
+    int64_t fromHome(uint32_t steps, uint32_t home) const;
+    uint32_t wrap(int64_t steps) const;
+
+    uint32_t m_stepsPerRevolution;
+    uint32_t m_homeRA;
+    uint32_t m_homeDec;
+    uint32_t m_maxLeg;
+    uint32_t m_cordwrap;
+    uint32_t m_counterweightLimit;
+
+    Waypoint m_waypoints[MAX_WAYPOINTS];
+    size_t m_count{0};
+};
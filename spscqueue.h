@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Bounded queue for exactly one producer thread and one consumer thread, without locks.
+
+The producer owns the tail and the consumer owns the head. Each side publishes its index with a
+release store and reads the other's with an acquire load, so an item is fully written before the
+consumer can see it and fully read before the producer can reuse its slot. The consumer keeps its
+last look at the tail and only reloads it when the queue seems empty, so draining a burst touches
+the producer's cache line once. The producer reads the head on every push, which keeps the depth
+it records exact.
+
+A push onto a full queue drops the new item and counts it. Items are copied into preallocated
+slots, so a T that reuses its storage on assignment doesn't allocate once the slots are warm.
+*/
+template <typename T, size_t N>
+class SPSCQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    static const size_t CAPACITY = N;
+
+    // Producer only.
+    bool push(const T &item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+
+        if (tail - head == N)
+        {
+            m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+            return false;
+        }
+
+        m_items[tail & (N - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        size_t depth = tail + 1 - head;
+        if (depth > m_highWater.load(std::memory_order_relaxed))
+            m_highWater.store(depth, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // Consumer only.
+    bool pop(T &item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tailCache)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tailCache)
+                return false;
+        }
+
+        item = m_items[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; a snapshot that may be stale by the time it's used.
+    size_t size() const
+    {
+        size_t head = m_head.load(std::memory_order_acquire);
+        return m_tail.load(std::memory_order_acquire) - head;
+    }
+
+    // The deepest the queue has been, as the producer saw it, and the items it had to drop.
+    size_t highWater() const
+    {
+        return m_highWater.load(std::memory_order_relaxed);
+    }
+    uint64_t overflows() const
+    {
+        return m_overflows.load(std::memory_order_relaxed);
+    }
+
+    // Empties the queue and zeroes the counts. Only while neither side is running.
+    void reset()
+    {
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_tailCache = 0;
+        m_highWater.store(0, std::memory_order_relaxed);
+        m_overflows.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    static const size_t CACHE_LINE = 64;
+
+    // Consumer side.
+    std::atomic<size_t> m_head{0};
+    size_t m_tailCache{0};
+    char m_consumerPad[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    // Producer side.
+    std::atomic<size_t> m_tail{0};
+    std::atomic<size_t> m_highWater{0};
+    std::atomic<uint64_t> m_overflows{0};
+    char m_producerPad[CACHE_LINE - 2 * sizeof(size_t) - sizeof(uint64_t)];
+
+    T m_items[N];
+};
+
+template <typename T, size_t N>
+const size_t SPSCQueue<T, N>::CAPACITY;
+
+template <typename T, size_t N>
+const size_t SPSCQueue<T, N>::CACHE_LINE;